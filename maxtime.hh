@@ -10,17 +10,317 @@
 #pragma once
 
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
+#include <charconv>
+#include <chrono>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <iomanip>
+#include <limits>
 #include <memory>
+#include <memory_resource>
+#include <new>
+#include <numeric>
 #include <queue>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
+#if defined(__unix__) || defined(__APPLE__)
+	#define MAXTIME_POSIX_MMAP 1
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+	#define MAXTIME_X86_KERNELS 1
+	#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+	#define MAXTIME_NEON_KERNELS 1
+	#include <arm_neon.h>
+#endif
+
+
+#include "thread_pool.hh"
+#include "timer.hh"
+
+
+// Instrumentation of the loaders and solvers, for finding where the time of a slow query
+// goes. Build with MAXTIME_INSTRUMENT defined to 1 to record the phases of each query into
+// the QueryStats passed to it; otherwise the phase markers compile to nothing, and
+// QueryStats only gets the counters that cost nothing to keep.
+#ifndef MAXTIME_INSTRUMENT
+	#define MAXTIME_INSTRUMENT 0
+#endif
+
+
+// One timed phase of a query, e.g. the fill loop of the dynamic algorithm.
+struct QueryPhase
+{
+	const char* name;
+
+	// On the scale of PrecisionTimer::now()
+	uint64_t start_nanoseconds;
+	uint64_t duration_nanoseconds;
+};
+
+
+// What a single load, filter or solve did, for the overloads that take a QueryStats.
+struct QueryStats
+{
+	// What ran, e.g. "dynamic/rolling_row" or "load/snapshot"
+	std::string engine;
+
+	// When it started, on the scale of PrecisionTimer::now(), and for how long it ran
+	uint64_t start_nanoseconds = 0;
+	double seconds = 0;
+
+	// In order of completion, so nested phases come before the phase around them;
+	// only recorded with MAXTIME_INSTRUMENT
+	std::vector<QueryPhase> phases;
+
+	// DP cells evaluated by the row kernels, and subsets visited by the exhaustive search
+	uint64_t cells = 0;
+	uint64_t masks = 0;
+
+	// Rides loaded, or kept by a filter
+	size_t rides = 0;
+
+	// Working memory of the solver: all bytes it allocated, and the most held at once
+	size_t bytes_allocated = 0;
+	size_t peak_bytes = 0;
+};
+
+
+// The QueryStats the phases of the calling thread go to; nullptr outside a query.
+QueryStats*& query_stats_sink()
+{
+	static thread_local QueryStats* stats = nullptr;
+	return stats;
+}
+
+
+// Makes stats the sink of the calling thread for the lifetime of the scope, and times it.
+class QueryStatsScope
+{
+	//
+	public:
+
+		//
+		explicit QueryStatsScope(QueryStats& stats)
+			:
+			_stats(stats),
+			_outer(query_stats_sink())
+		{
+			_stats.start_nanoseconds = _timer.start();
+			query_stats_sink() = &_stats;
+		}
+
+		//
+		~QueryStatsScope()
+		{
+			_stats.seconds = _timer.elapsed();
+			query_stats_sink() = _outer;
+		}
+
+		QueryStatsScope(const QueryStatsScope&) = delete;
+		QueryStatsScope& operator=(const QueryStatsScope&) = delete;
+
+	//
+	private:
+
+		//
+		QueryStats& _stats;
+		QueryStats* _outer;
+		PrecisionTimer _timer;
+};
+
+
+// Times a phase from construction, or the last next(), to the next next() or destruction,
+// recording it into the sink of the calling thread if there is one. Use through MAXTIME_PHASE.
+class QueryPhaseScope
+{
+	//
+	public:
+
+		//
+		explicit QueryPhaseScope(const char* name)
+			:
+			_stats(query_stats_sink()),
+			_name(name),
+			_start(_stats ? PrecisionTimer::now() : 0)
+		{}
+
+		//
+		~QueryPhaseScope() { finish(); }
+
+		QueryPhaseScope(const QueryPhaseScope&) = delete;
+		QueryPhaseScope& operator=(const QueryPhaseScope&) = delete;
+
+		// End the current phase and start the one called name.
+		void next(const char* name)
+		{
+			finish();
+			_name = name;
+			_start = _stats ? PrecisionTimer::now() : 0;
+		}
+
+	//
+	private:
+
+		//
+		void finish()
+		{
+			if (_stats)
+			{
+				_stats->phases.push_back(QueryPhase { _name, _start, PrecisionTimer::now() - _start });
+			}
+		}
+
+		//
+		QueryStats* _stats;
+		const char* _name;
+		uint64_t _start;
+};
+
+
+// MAXTIME_PHASE(scope, "name") starts a phase that lasts until MAXTIME_NEXT_PHASE(scope, "next")
+// or the end of the enclosing block.
+#if MAXTIME_INSTRUMENT
+	#define MAXTIME_PHASE(scope, name) QueryPhaseScope scope(name)
+	#define MAXTIME_NEXT_PHASE(scope, name) scope.next(name)
+#else
+	#define MAXTIME_PHASE(scope, name) ((void)0)
+	#define MAXTIME_NEXT_PHASE(scope, name) ((void)0)
+#endif
+
+
+// Memory resource that passes allocations on to upstream, and counts their bytes.
+class CountingResource : public std::pmr::memory_resource
+{
+	//
+	public:
+
+		//
+		explicit CountingResource(std::pmr::memory_resource* upstream = std::pmr::get_default_resource())
+			:
+			_upstream(upstream)
+		{}
+
+		// All bytes allocated, and the most outstanding at once.
+		size_t allocated() const { return _allocated; }
+		size_t peak() const { return _peak; }
+
+	//
+	private:
+
+		//
+		void* do_allocate(size_t bytes, size_t alignment) override
+		{
+			void* result = _upstream->allocate(bytes, alignment);
+			_allocated += bytes;
+			_outstanding += bytes;
+			_peak = std::max(_peak, _outstanding);
+			return result;
+		}
+
+		//
+		void do_deallocate(void* pointer, size_t bytes, size_t alignment) override
+		{
+			_outstanding -= bytes;
+			_upstream->deallocate(pointer, bytes, alignment);
+		}
+
+		//
+		bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+		{
+			return this == &other;
+		}
+
+		//
+		std::pmr::memory_resource* _upstream;
+		size_t _allocated = 0, _outstanding = 0, _peak = 0;
+};
+
+
+// text as the body of a JSON string: quotes, backslashes and control characters escaped.
+std::string json_escape(std::string_view text)
+{
+	std::string escaped;
+	escaped.reserve(text.size());
+	for (char c : text)
+	{
+		if (c == '"' || c == '\\')
+		{
+			escaped += '\\';
+			escaped += c;
+		}
+		else if (static_cast<unsigned char>(c) < 0x20)
+		{
+			static const char digits[] = "0123456789abcdef";
+			escaped += "\\u00";
+			escaped += digits[(c >> 4) & 0xf];
+			escaped += digits[c & 0xf];
+		}
+		else
+		{
+			escaped += c;
+		}
+	}
+	return escaped;
+}
+
+
+// Write queries in the Chrome trace event format, for chrome://tracing or Perfetto: each
+// query is a complete event on a track of its own, with its counters as arguments, and its
+// phases are events nested inside it. Times are in microseconds from the first query.
+void write_chrome_trace(std::ostream& out, const std::vector<QueryStats>& queries)
+{
+	uint64_t origin = UINT64_MAX;
+	for (const QueryStats& query : queries)
+	{
+		origin = std::min(origin, query.start_nanoseconds);
+	}
+
+	std::ostringstream events;
+	events << std::fixed << std::setprecision(3);
+	auto event = [&](std::string_view name, size_t track, uint64_t start, double microseconds)
+	{
+		events
+			<< (events.tellp() > 0 ? ",\n" : "")
+			<< "{\"name\":\"" << json_escape(name) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << track
+			<< ",\"ts\":" << (start - origin) / 1e3 << ",\"dur\":" << microseconds;
+	};
+	for (size_t i = 0; i < queries.size(); i++)
+	{
+		const QueryStats& query = queries[i];
+		event(query.engine, i + 1, query.start_nanoseconds, query.seconds * 1e6);
+		events
+			<< ",\"args\":{\"cells\":" << query.cells << ",\"masks\":" << query.masks
+			<< ",\"rides\":" << query.rides << ",\"bytes_allocated\":" << query.bytes_allocated
+			<< ",\"peak_bytes\":" << query.peak_bytes << "}}";
+		for (const QueryPhase& phase : query.phases)
+		{
+			event(phase.name, i + 1, phase.start_nanoseconds, phase.duration_nanoseconds / 1e3);
+			events << "}";
+		}
+	}
+	out << "{\"traceEvents\":[\n" << events.str() << "\n]}\n";
+}
+
 
 // One ride item available for purchase.
 class RideItem
@@ -67,301 +367,5136 @@ class RideItem
 typedef std::vector<std::shared_ptr<RideItem>> RideVector;
 
 
-// Load all the valid ride items from the CSV database
-// ride items that are missing fields, or have invalid values, are skipped.
-// Returns nullptr on I/O error.
-std::unique_ptr<RideVector> load_ride_database(const std::string& path)
+// Positions of chosen rides within the list of rides given to a solver.
+// Lists are allocated from the default memory resource unless constructed with another one,
+// such as the resource of a QueryArena.
+typedef std::pmr::vector<size_t> RideIndexList;
+
+
+// Scratch memory for one query: the solver overloads that take an arena allocate their
+// working rows, decisions and result from it, and reset() frees all of it in one step.
+// Memory comes from a buffer owned by the arena; when a query outgrows it, the overflow is
+// taken from the heap, and the next reset() grows the buffer to cover it, so repeated
+// queries of the same size allocate nothing from the heap. Not thread-safe.
+class QueryArena
 {
-	std::unique_ptr<RideVector> failure(nullptr);
+	//
+	public:
 
-	std::ifstream f(path);
-	if (!f)
-	{
-		std::cout << "Failed to load ride database; Cannot open file: " << path << std::endl;
-		return failure;
-	}
+		//
+		explicit QueryArena(size_t initial_bytes = 1 << 16)
+			:
+			_buffer(std::max<size_t>(initial_bytes, 1)),
+			_resource(new std::pmr::monotonic_buffer_resource(_buffer.data(), _buffer.size(), &_overflow))
+		{}
 
-	std::unique_ptr<RideVector> result(new RideVector);
+		QueryArena(const QueryArena&) = delete;
+		QueryArena& operator=(const QueryArena&) = delete;
 
-	size_t line_number = 0;
-	for (std::string line; std::getline(f, line); )
-	{
-		line_number++;
+		//
+		std::pmr::memory_resource* resource() { return _resource.get(); }
+
+		// Bytes in the buffer, and bytes taken from the heap since the last reset()
+		size_t capacity() const { return _buffer.size(); }
+		size_t overflow_bytes() const { return _overflow.bytes(); }
 
-		// First line is a header row
-		if ( line_number == 1 )
+		// Free everything allocated from the arena.
+		// Anything allocated from it must not be used afterwards.
+		void reset()
 		{
-			continue;
+			size_t grown = _overflow.bytes() > 0 ? _buffer.size() + _overflow.bytes() : 0;
+			_resource->release();
+			_overflow.clear();
+			if (grown > 0)
+			{
+				_resource.reset();
+				_buffer.assign(grown, std::byte(0));
+				_resource.reset(new std::pmr::monotonic_buffer_resource(_buffer.data(), _buffer.size(), &_overflow));
+			}
 		}
 
-		std::vector<std::string> fields;
-		std::stringstream ss(line);
+	//
+	private:
 
-		for (std::string field; std::getline(ss, field, '^'); )
+		// The heap, counting what the arena takes from it.
+		class OverflowResource : public std::pmr::memory_resource
 		{
-			fields.push_back(field);
-		}
+			//
+			public:
 
-		if (fields.size() != 3)
-		{
-			std::cout
-				<< "Failed to load ride database: Invalid field count at line " << line_number << "; Want 3 but got " << fields.size() << std::endl
-				<< "Line: " << line << std::endl
-				;
-			return failure;
-		}
+				//
+				size_t bytes() const { return _bytes; }
+				void clear() { _bytes = 0; }
 
-		std::string
-			descr_field = fields[0],
-			cost_dollars_field = fields[1],
-			time_minutes_field = fields[2]
-			;
+			//
+			private:
+
+				//
+				void* do_allocate(size_t bytes, size_t alignment) override
+				{
+					_bytes += bytes;
+					return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+				}
+
+				//
+				void do_deallocate(void* p, size_t bytes, size_t alignment) override
+				{
+					std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+				}
+
+				//
+				bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+				{
+					return this == &other;
+				}
+
+				//
+				size_t _bytes = 0;
+		};
+
+		//
+		std::vector<std::byte> _buffer;
+		OverflowResource _overflow;
+		std::unique_ptr<std::pmr::monotonic_buffer_resource> _resource;
+};
+
+
+// A fixed number of RideItems in one allocation, built in place by emplace(). rides() hands
+// them out as shared_ptrs that all share the catalog's single control block, so loading a
+// database costs one allocation for the items rather than two per ride; the description of a
+// ride is still a std::string of its own, which allocates when it is too long to be stored
+// inline. The catalog must be owned by a shared_ptr, see make_ride_catalog, and lives until
+// the last of its rides is released.
+class RideCatalog : public std::enable_shared_from_this<RideCatalog>
+{
+	//
+	public:
+
+		//
+		explicit RideCatalog(size_t count)
+			:
+			_count(count),
+			_items(static_cast<RideItem*>(::operator new(std::max<size_t>(count, 1) * sizeof(RideItem)))),
+			_built(count, 0)
+		{}
 
-		auto parse_dbl = [](const std::string& field, double& output)
+		//
+		~RideCatalog()
 		{
-			std::stringstream ss(field);
-			if ( ! ss )
+			for (size_t i = 0; i < _count; i++)
 			{
-				return false;
+				if (_built[i])
+				{
+					_items[i].~RideItem();
+				}
 			}
+			::operator delete(_items);
+		}
 
-			ss >> output;
+		RideCatalog(const RideCatalog&) = delete;
+		RideCatalog& operator=(const RideCatalog&) = delete;
 
-			return true;
-		};
+		//
+		size_t size() const { return _count; }
+		const RideItem& operator[](size_t i) const { assert(_built[i]); return _items[i]; }
 
-		std::string description(descr_field);
-		double cost_dollars, time_minutes;
-		if (
-			parse_dbl(cost_dollars_field, cost_dollars)
-			&& parse_dbl(time_minutes_field, time_minutes)
-		)
+		// Build item i; each item is built once. Distinct items may be built from different
+		// threads at once.
+		void emplace(size_t i, std::string_view description, int cost, double time)
 		{
-			result->push_back(
-				std::shared_ptr<RideItem>(
-					new RideItem(
-						description,
-						cost_dollars,
-						time_minutes
-					)
-				)
-			);
+			assert(i < _count && !_built[i]);
+			new (_items + i) RideItem(std::string(description), cost, time);
+			_built[i] = 1;
 		}
-	}
 
-	f.close();
+		// Every item, in order; all of them must have been built.
+		std::unique_ptr<RideVector> rides()
+		{
+			std::shared_ptr<RideCatalog> self = shared_from_this();
+			std::unique_ptr<RideVector> result(new RideVector);
+			result->reserve(_count);
+			for (size_t i = 0; i < _count; i++)
+			{
+				assert(_built[i]);
+				result->push_back(std::shared_ptr<RideItem>(self, _items + i));
+			}
+			return result;
+		}
 
-	return result;
-}
+	//
+	private:
 
+		//
+		size_t _count;
+		RideItem* _items;
+		std::vector<uint8_t> _built;
+};
 
-// Convenience function to compute the total cost and time in a RideVector.
-// Provide the RideVector as the first argument
-// The next two arguments will return the cost and time back to the caller.
-void sum_ride_vector
-(
-	const RideVector& rides,
-	int& total_cost,
-	double& total_time
-)
+
+// A RideCatalog of count items; the catalog and its control block share one allocation.
+std::shared_ptr<RideCatalog> make_ride_catalog(size_t count)
 {
-	total_cost = total_time = 0;
-	for (auto& ride : rides)
-	{
-		total_cost += ride->cost();
-		total_time += ride->time();
-	}
+	return std::make_shared<RideCatalog>(count);
 }
 
 
-// Convenience function to print out each RideItem in a RideVector,
-// followed by the total kilocalories and protein in it.
-void print_ride_vector(const RideVector& rides)
+// Read-only view of a whole file; memory-mapped on POSIX systems, read into memory elsewhere.
+class MappedFile
 {
-	std::cout << "*** ride Vector ***" << std::endl;
+	//
+	public:
 
-	if ( rides.size() == 0 )
-	{
-		std::cout << "[empty ride list]" << std::endl;
-	}
-	else
-	{
-		for (auto& ride : rides)
+		//
+		explicit MappedFile(const std::string& path)
 		{
-			std::cout
-				<< "Ye olde " << ride->description()
-				<< " ==> "
-				<< "Cost of " << ride->cost() << " dollars"
-				<< "; time = " << ride->time()
-				<< std::endl
-				;
+#ifdef MAXTIME_POSIX_MMAP
+			int fd = ::open(path.c_str(), O_RDONLY);
+			if (fd < 0)
+			{
+				return;
+			}
+			struct stat status;
+			if (::fstat(fd, &status) == 0)
+			{
+				_size = size_t(status.st_size);
+				if (_size == 0)
+				{
+					_open = true;
+				}
+				else
+				{
+					void* mapping = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+					if (mapping != MAP_FAILED)
+					{
+						::madvise(mapping, _size, MADV_SEQUENTIAL);
+						_data = static_cast<const char*>(mapping);
+						_open = true;
+					}
+				}
+			}
+			::close(fd);
+#else
+			std::ifstream f(path, std::ios::binary);
+			if (f)
+			{
+				_contents.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+				_data = _contents.data();
+				_size = _contents.size();
+				_open = true;
+			}
+#endif
 		}
 
-		int total_cost;
-		double total_time;
-		sum_ride_vector(rides, total_cost, total_time);
-		std::cout
-			<< "> Grand total cost: " << total_cost << " dollars" << std::endl
-			<< "> Grand total time: " << total_time
-			<< std::endl
-			;
-	}
-}
+		//
+		~MappedFile()
+		{
+#ifdef MAXTIME_POSIX_MMAP
+			if (_data)
+			{
+				::munmap(const_cast<char*>(_data), _size);
+			}
+#endif
+		}
 
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
 
-// Convenience function to print out a 2D cache, composed of a std::vector<std::vector<double>>
-// For sanity, will refuse to print a cache that is too large.
-// Hint: When running this program, you can redirect stdout to a file,
-//	which may be easier to view and inspect than a terminal
-void print_2d_cache(const std::vector<std::vector<double>>& cache)
-{
-	std::cout << "*** 2D Cache ***" << std::endl;
+		//
+		bool is_open() const { return _open; }
+		const char* data() const { return _data; }
+		size_t size() const { return _size; }
+		std::string_view view() const { return std::string_view(_data, _size); }
 
-	if ( cache.size() == 0 )
-	{
-		std::cout << "[empty]" << std::endl;
-	}
-	else if ( cache.size() > 250 || cache[1].size() > 250 )
+	//
+	private:
+
+		//
+		const char* _data = nullptr;
+		size_t _size = 0;
+		bool _open = false;
+
+#ifndef MAXTIME_POSIX_MMAP
+		std::string _contents;
+#endif
+};
+
+
+// One row of the ride database, with its description pointing into the text it was
+// parsed from.
+struct RideRecord
+{
+	std::string_view description;
+	int cost;
+	double time;
+};
+
+
+// Outcome of parsing lines of the ride database.
+struct RideParseResult
+{
+	// Valid rows, in file order
+	std::vector<RideRecord> records;
+
+	// Lines read
+	size_t lines = 0;
+
+	// Line numbers of the rows with the right number of fields but invalid values,
+	// which are left out
+	std::vector<size_t> skipped_lines;
+
+	// Line number, and text and field count, of the first line without exactly 3 fields;
+	// zero when there is none. Parsing stops there.
+	size_t error_line = 0;
+	std::string_view error_text;
+	size_t error_fields = 0;
+};
+
+
+// Parse a number from the whole of field, allowing surrounding blanks; false if it isn't one.
+bool parse_ride_number(std::string_view field, double& output)
+{
+	const char* begin = field.data();
+	const char* end = begin + field.size();
+	while (begin < end && (*begin == ' ' || *begin == '\t'))
+	{
+		begin++;
+	}
+	while (end > begin && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r'))
+	{
+		end--;
+	}
+	if (begin < end && *begin == '+')
+	{
+		begin++;
+	}
+	if (begin == end)
+	{
+		return false;
+	}
+
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+	auto parsed = std::from_chars(begin, end, output);
+	return parsed.ec == std::errc() && parsed.ptr == end;
+#else
+	char buffer[64];
+	size_t length = size_t(end - begin);
+	if (length >= sizeof(buffer))
+	{
+		return false;
+	}
+	std::memcpy(buffer, begin, length);
+	buffer[length] = '\0';
+	char* stop;
+	output = std::strtod(buffer, &stop);
+	return stop == buffer + length;
+#endif
+}
+
+
+// Parse the rides in text, which holds whole lines of the database (no header), numbering
+// them from first_line. Lines end with '\n'; fields are separated by '^', with a trailing '^'
+// ignored, as std::getline sees them. A row is skipped when its description is empty, its
+// cost (truncated to whole dollars) isn't positive, its time isn't finite (std::from_chars
+// takes "nan" and "inf"), or either number doesn't parse. Negative times are kept, as the
+// filters leave them out.
+// Returns false when some line has the wrong number of fields; see RideParseResult.
+bool parse_ride_lines(std::string_view text, size_t first_line, RideParseResult& result)
+{
+	const char* cursor = text.data();
+	const char* end = cursor + text.size();
+	for (size_t line_number = first_line; cursor < end; line_number++)
+	{
+		const char* newline = static_cast<const char*>(std::memchr(cursor, '\n', end - cursor));
+		const char* line_end = newline ? newline : end;
+		result.lines++;
+
+		// Like std::getline, a trailing '^' doesn't start another, empty, field
+		std::string_view fields[3];
+		size_t field_count = 0;
+		for (const char* field = cursor; field < line_end; )
+		{
+			const char* caret = static_cast<const char*>(std::memchr(field, '^', line_end - field));
+			const char* field_end = caret ? caret : line_end;
+			if (field_count < 3)
+			{
+				fields[field_count] = std::string_view(field, field_end - field);
+			}
+			field_count++;
+			field = caret ? caret + 1 : line_end;
+		}
+		if (field_count != 3)
+		{
+			result.error_line = line_number;
+			result.error_text = std::string_view(cursor, line_end - cursor);
+			result.error_fields = field_count;
+			return false;
+		}
+
+		double cost_dollars, time_minutes;
+		if (
+			!fields[0].empty()
+			&& parse_ride_number(fields[1], cost_dollars)
+			&& parse_ride_number(fields[2], time_minutes)
+			&& cost_dollars >= 1
+			&& cost_dollars <= double(std::numeric_limits<int>::max())
+			&& std::isfinite(time_minutes)
+		)
+		{
+			result.records.push_back(RideRecord{fields[0], int(cost_dollars), time_minutes});
+		}
+		else
+		{
+			result.skipped_lines.push_back(line_number);
+		}
+
+		cursor = newline ? newline + 1 : end;
+	}
+	return true;
+}
+
+
+// Print the message for the first malformed line of the ride database.
+void report_ride_parse_error(const RideParseResult& result)
+{
+	std::cout
+		<< "Failed to load ride database: Invalid field count at line " << result.error_line << "; Want 3 but got " << result.error_fields << std::endl
+		<< "Line: " << result.error_text << std::endl
+		;
+}
+
+
+// The ride database, parsed in place: every record's description points into the mapped
+// file, which this object keeps open.
+class MappedRideDatabase
+{
+	//
+	public:
+
+		//
+		explicit MappedRideDatabase(const std::string& path) : _file(path) {}
+
+		MappedRideDatabase(const MappedRideDatabase&) = delete;
+		MappedRideDatabase& operator=(const MappedRideDatabase&) = delete;
+
+		//
+		const MappedFile& file() const { return _file; }
+		const std::vector<RideRecord>& records() const { return _parsed.records; }
+
+		// Rows left out for invalid values, and their line numbers
+		size_t skipped() const { return _parsed.skipped_lines.size(); }
+		const std::vector<size_t>& skipped_lines() const { return _parsed.skipped_lines; }
+
+		// For the loader functions
+		RideParseResult& parsed() { return _parsed; }
+
+		// Copy the records into RideItems, kept in one RideCatalog.
+		std::unique_ptr<RideVector> to_ride_vector() const
+		{
+			std::shared_ptr<RideCatalog> catalog = make_ride_catalog(_parsed.records.size());
+			for (size_t i = 0; i < catalog->size(); i++)
+			{
+				const RideRecord& record = _parsed.records[i];
+				catalog->emplace(i, record.description, record.cost, record.time);
+			}
+			return catalog->rides();
+		}
+
+		// Copy the records into RideItems on the threads of pool.
+		std::unique_ptr<RideVector> to_ride_vector(ThreadPool& pool) const
+		{
+			std::shared_ptr<RideCatalog> catalog = make_ride_catalog(_parsed.records.size());
+			pool.parallel_for(catalog->size(), 1024, [&](size_t i)
+			{
+				const RideRecord& record = _parsed.records[i];
+				catalog->emplace(i, record.description, record.cost, record.time);
+			});
+			return catalog->rides();
+		}
+
+	//
+	private:
+
+		//
+		MappedFile _file;
+		RideParseResult _parsed;
+};
+
+
+// The text of the database after its header line, which is line 1.
+std::string_view ride_database_body(std::string_view text)
+{
+	size_t newline = text.find('\n');
+	return newline == std::string_view::npos ? std::string_view() : text.substr(newline + 1);
+}
+
+
+// Map and parse the ride database without copying any descriptions.
+// Returns nullptr on I/O error, or when a line doesn't have 3 fields.
+std::unique_ptr<MappedRideDatabase> load_mapped_ride_database(const std::string& path)
+{
+	std::unique_ptr<MappedRideDatabase> database(new MappedRideDatabase(path));
+	if (!database->file().is_open())
+	{
+		std::cout << "Failed to load ride database; Cannot open file: " << path << std::endl;
+		return nullptr;
+	}
+
+	if (!parse_ride_lines(ride_database_body(database->file().view()), 2, database->parsed()))
+	{
+		report_ride_parse_error(database->parsed());
+		return nullptr;
+	}
+	return database;
+}
+
+
+// Parse text, which holds whole lines of the database starting at line first_line, on the
+// threads of pool, with the same result as parse_ride_lines.
+// The text is cut into one chunk per thread, each starting just after a newline; every thread
+// parses its chunk into its own result with line numbers relative to the chunk, and the
+// results are then concatenated in file order, with the line numbers shifted by the number of
+// lines in the chunks before.
+bool parallel_parse_ride_lines(std::string_view text, size_t first_line, ThreadPool& pool, RideParseResult& result)
+{
+	// Small chunks aren't worth a thread
+	const size_t min_chunk_bytes = 1 << 16;
+	size_t chunks = std::max<size_t>(1, std::min(pool.size(), text.size() / min_chunk_bytes));
+	if (chunks == 1)
+	{
+		return parse_ride_lines(text, first_line, result);
+	}
+
+	std::vector<size_t> starts(chunks + 1, text.size());
+	starts[0] = 0;
+	for (size_t k = 1; k < chunks; k++)
+	{
+		size_t newline = text.find('\n', std::max(starts[k - 1], text.size() / chunks * k));
+		starts[k] = newline == std::string_view::npos ? text.size() : newline + 1;
+	}
+
+	std::vector<RideParseResult> parts(chunks);
+	std::vector<char> parsed(chunks, true);
+	pool.run_team([&](size_t index)
+	{
+		for (size_t k = index; k < chunks; k += pool.size())
+		{
+			parsed[k] = parse_ride_lines(text.substr(starts[k], starts[k + 1] - starts[k]), 0, parts[k]);
+		}
+	});
+
+	size_t total = 0;
+	for (const RideParseResult& part : parts)
+	{
+		total += part.records.size();
+	}
+	result.records.reserve(result.records.size() + total);
+
+	size_t line = first_line;
+	for (size_t k = 0; k < chunks; k++)
+	{
+		RideParseResult& part = parts[k];
+		result.records.insert(result.records.end(), part.records.begin(), part.records.end());
+		for (size_t skipped : part.skipped_lines)
+		{
+			result.skipped_lines.push_back(line + skipped);
+		}
+		result.lines += part.lines;
+		if (!parsed[k])
+		{
+			result.error_line = line + part.error_line;
+			result.error_text = part.error_text;
+			result.error_fields = part.error_fields;
+			return false;
+		}
+		line += part.lines;
+	}
+	return true;
+}
+
+
+// load_mapped_ride_database, parsing on the threads of pool.
+std::unique_ptr<MappedRideDatabase> load_mapped_ride_database(const std::string& path, ThreadPool& pool)
+{
+	std::unique_ptr<MappedRideDatabase> database(new MappedRideDatabase(path));
+	if (!database->file().is_open())
+	{
+		std::cout << "Failed to load ride database; Cannot open file: " << path << std::endl;
+		return nullptr;
+	}
+
+	if (!parallel_parse_ride_lines(ride_database_body(database->file().view()), 2, pool, database->parsed()))
+	{
+		report_ride_parse_error(database->parsed());
+		return nullptr;
+	}
+	return database;
+}
+
+
+// Fixed-size header at the start of a ride snapshot file.
+// A snapshot is the header, then the costs as int32, the times as doubles, count + 1 offsets
+// of the descriptions in the string pool as uint64, and the string pool itself; every array
+// starts at a multiple of 8 bytes. Numbers are in the byte order of the machine that wrote
+// the snapshot, which byte_order identifies.
+struct RideSnapshotHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint64_t count;
+
+	// Size and modification time of the CSV database the snapshot was made from
+	uint64_t source_size;
+	int64_t source_mtime;
+
+	// Byte offsets from the start of the file
+	uint64_t costs_offset;
+	uint64_t times_offset;
+	uint64_t description_offsets_offset;
+	uint64_t pool_offset;
+	uint64_t pool_size;
+};
+
+
+// Identification of the current snapshot format.
+const char ride_snapshot_magic[8] = { 'R', 'I', 'D', 'E', 'S', 'N', 'A', 'P' };
+const uint32_t ride_snapshot_version = 1;
+const uint32_t ride_snapshot_byte_order = 0x01020304;
+
+
+// Where load_ride_database looks for the snapshot of the CSV database at path.
+std::string ride_snapshot_path(const std::string& path)
+{
+	return path + ".snapshot";
+}
+
+
+// Size and modification time of the file at path, as recorded in snapshot headers;
+// false when the file can't be inspected.
+bool ride_source_stamp(const std::string& path, uint64_t& size, int64_t& mtime)
+{
+	std::error_code error;
+	auto file_size = std::filesystem::file_size(path, error);
+	if (error)
+	{
+		return false;
+	}
+	auto write_time = std::filesystem::last_write_time(path, error);
+	if (error)
+	{
+		return false;
+	}
+	size = uint64_t(file_size);
+	mtime = int64_t(write_time.time_since_epoch().count());
+	return true;
+}
+
+
+// Write rides to a snapshot at snapshot_path, stamped with the current size and modification
+// time of the CSV database at source_path. Returns false on I/O error.
+bool write_ride_snapshot
+(
+	const RideVector& rides,
+	const std::string& snapshot_path,
+	const std::string& source_path
+)
+{
+	auto align = [](uint64_t offset) { return (offset + 7) / 8 * 8; };
+
+	RideSnapshotHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, ride_snapshot_magic, sizeof(header.magic));
+	header.version = ride_snapshot_version;
+	header.byte_order = ride_snapshot_byte_order;
+	header.count = rides.size();
+	if (!ride_source_stamp(source_path, header.source_size, header.source_mtime))
+	{
+		return false;
+	}
+
+	std::vector<int32_t> costs;
+	std::vector<double> times;
+	std::vector<uint64_t> offsets(1, 0);
+	std::string pool;
+	for (auto& ride : rides)
+	{
+		costs.push_back(ride->cost());
+		times.push_back(ride->time());
+		pool += ride->description();
+		offsets.push_back(pool.size());
+	}
+
+	header.costs_offset = align(sizeof(header));
+	header.times_offset = align(header.costs_offset + costs.size() * sizeof(int32_t));
+	header.description_offsets_offset = align(header.times_offset + times.size() * sizeof(double));
+	header.pool_offset = header.description_offsets_offset + offsets.size() * sizeof(uint64_t);
+	header.pool_size = pool.size();
+
+	std::ofstream f(snapshot_path, std::ios::binary | std::ios::trunc);
+	if (!f)
+	{
+		return false;
+	}
+	auto write_at = [&](uint64_t offset, const void* data, size_t bytes)
+	{
+		static const char padding[8] = {};
+		f.write(padding, std::streamsize(offset - uint64_t(f.tellp())));
+		f.write(static_cast<const char*>(data), std::streamsize(bytes));
+	};
+	write_at(0, &header, sizeof(header));
+	write_at(header.costs_offset, costs.data(), costs.size() * sizeof(int32_t));
+	write_at(header.times_offset, times.data(), times.size() * sizeof(double));
+	write_at(header.description_offsets_offset, offsets.data(), offsets.size() * sizeof(uint64_t));
+	write_at(header.pool_offset, pool.data(), pool.size());
+	return bool(f);
+}
+
+
+// A ride snapshot, memory-mapped; opening one only validates its header, and the accessors
+// read straight from the mapping.
+class RideSnapshot
+{
+	//
+	public:
+
+		//
+		explicit RideSnapshot(const std::string& path) : _file(path) {}
+
+		RideSnapshot(const RideSnapshot&) = delete;
+		RideSnapshot& operator=(const RideSnapshot&) = delete;
+
+		// Whether the file is a complete snapshot of the current version, for this machine.
+		// Every section and description must lie inside the file, so once this holds, no
+		// accessor reads outside the mapping; the rides must also be valid RideItems.
+		bool is_valid() const
+		{
+			if (!_file.is_open() || _file.size() < sizeof(RideSnapshotHeader))
+			{
+				return false;
+			}
+			const RideSnapshotHeader& h = header();
+			uint64_t count = h.count;
+			if (std::memcmp(h.magic, ride_snapshot_magic, sizeof(h.magic)) != 0
+				|| h.version != ride_snapshot_version
+				|| h.byte_order != ride_snapshot_byte_order
+				|| h.costs_offset % 8 != 0 || h.times_offset % 8 != 0 || h.description_offsets_offset % 8 != 0
+				|| count == UINT64_MAX
+				|| !section_fits(h.costs_offset, count, sizeof(int32_t), h.times_offset)
+				|| !section_fits(h.times_offset, count, sizeof(double), h.description_offsets_offset)
+				|| !section_fits(h.description_offsets_offset, count + 1, sizeof(uint64_t), h.pool_offset)
+				|| !section_fits(h.pool_offset, h.pool_size, 1, _file.size())
+				|| h.pool_offset + h.pool_size != _file.size())
+			{
+				return false;
+			}
+
+			// Descriptions are non-empty, in order, and end with the pool; costs are positive and
+			// times finite, as the parser keeps them
+			const uint64_t* offsets = description_offsets();
+			if (offsets[0] != 0 || offsets[count] != h.pool_size)
+			{
+				return false;
+			}
+			for (uint64_t i = 0; i < count; i++)
+			{
+				if (offsets[i] >= offsets[i + 1] || costs()[i] <= 0 || !std::isfinite(times()[i]))
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		// Whether the snapshot was made from the CSV database at source_path as it is now.
+		bool is_fresh(const std::string& source_path) const
+		{
+			uint64_t size;
+			int64_t mtime;
+			return ride_source_stamp(source_path, size, mtime)
+				&& size == header().source_size
+				&& mtime == header().source_mtime;
+		}
+
+		//
+		size_t size() const { return header().count; }
+		const int32_t* costs() const { return reinterpret_cast<const int32_t*>(_file.data() + header().costs_offset); }
+		const double* times() const { return reinterpret_cast<const double*>(_file.data() + header().times_offset); }
+
+		//
+		std::string_view description(size_t i) const
+		{
+			const uint64_t* offsets = description_offsets();
+			return std::string_view(_file.data() + header().pool_offset + offsets[i], offsets[i + 1] - offsets[i]);
+		}
+
+		// Copy the snapshot into RideItems, kept in one RideCatalog.
+		std::unique_ptr<RideVector> to_ride_vector() const
+		{
+			std::shared_ptr<RideCatalog> catalog = make_ride_catalog(size());
+			for (size_t i = 0; i < size(); i++)
+			{
+				catalog->emplace(i, description(i), costs()[i], times()[i]);
+			}
+			return catalog->rides();
+		}
+
+	//
+	private:
+
+		// Whether count elements of the given size, from offset, end by limit, without overflow.
+		static bool section_fits(uint64_t offset, uint64_t count, uint64_t element, uint64_t limit)
+		{
+			return offset <= limit && count <= (limit - offset) / element;
+		}
+
+		//
+		const RideSnapshotHeader& header() const { return *reinterpret_cast<const RideSnapshotHeader*>(_file.data()); }
+		const uint64_t* description_offsets() const { return reinterpret_cast<const uint64_t*>(_file.data() + header().description_offsets_offset); }
+
+		//
+		MappedFile _file;
+};
+
+
+// Open the snapshot at path; nullptr when it is missing or not a valid snapshot.
+std::unique_ptr<RideSnapshot> open_ride_snapshot(const std::string& path)
+{
+	std::unique_ptr<RideSnapshot> snapshot(new RideSnapshot(path));
+	if (!snapshot->is_valid())
+	{
+		return nullptr;
+	}
+	return snapshot;
+}
+
+
+// The snapshot next to the CSV database at path, if there is one and it is up to date.
+std::unique_ptr<RideSnapshot> open_fresh_ride_snapshot(const std::string& path)
+{
+	std::unique_ptr<RideSnapshot> snapshot = open_ride_snapshot(ride_snapshot_path(path));
+	if (!snapshot || !snapshot->is_fresh(path))
+	{
+		return nullptr;
+	}
+	return snapshot;
+}
+
+
+// Load all the valid ride items from the CSV database
+// ride items that are missing fields, or have invalid values, are skipped.
+// Returns nullptr on I/O error.
+// When an up-to-date snapshot of the database sits next to it (see write_ride_snapshot and
+// ride_snapshot_path), the rides are read from that instead, without any parsing.
+std::unique_ptr<RideVector> load_ride_database(const std::string& path)
+{
+	MAXTIME_PHASE(phase, "snapshot");
+	if (std::unique_ptr<RideSnapshot> snapshot = open_fresh_ride_snapshot(path))
+	{
+		MAXTIME_NEXT_PHASE(phase, "build");
+		return snapshot->to_ride_vector();
+	}
+
+	MAXTIME_NEXT_PHASE(phase, "parse");
+	std::unique_ptr<MappedRideDatabase> database = load_mapped_ride_database(path);
+	if (!database)
+	{
+		return nullptr;
+	}
+	MAXTIME_NEXT_PHASE(phase, "build");
+	return database->to_ride_vector();
+}
+
+
+// load_ride_database, reporting into stats.
+std::unique_ptr<RideVector> load_ride_database(const std::string& path, QueryStats& stats)
+{
+	stats = QueryStats();
+	stats.engine = "load";
+	std::unique_ptr<RideVector> rides;
+	{
+		QueryStatsScope scope(stats);
+		rides = load_ride_database(path);
+	}
+	stats.rides = rides ? rides->size() : 0;
+	return rides;
+}
+
+
+// load_ride_database, parsing and building the RideItems on the given number of threads.
+// The rides come out in file order, as with one thread.
+std::unique_ptr<RideVector> load_ride_database(const std::string& path, size_t threads)
+{
+	MAXTIME_PHASE(phase, "snapshot");
+	if (std::unique_ptr<RideSnapshot> snapshot = open_fresh_ride_snapshot(path))
+	{
+		MAXTIME_NEXT_PHASE(phase, "build");
+		return snapshot->to_ride_vector();
+	}
+
+	MAXTIME_NEXT_PHASE(phase, "parse");
+	ThreadPool& pool = shared_thread_pool(threads);
+	std::unique_ptr<MappedRideDatabase> database = load_mapped_ride_database(path, pool);
+	if (!database)
+	{
+		return nullptr;
+	}
+	MAXTIME_NEXT_PHASE(phase, "build");
+	return database->to_ride_vector(pool);
+}
+
+
+// load_ride_database on the given number of threads, reporting into stats.
+std::unique_ptr<RideVector> load_ride_database(const std::string& path, size_t threads, QueryStats& stats)
+{
+	stats = QueryStats();
+	stats.engine = "load";
+	std::unique_ptr<RideVector> rides;
+	{
+		QueryStatsScope scope(stats);
+		rides = load_ride_database(path, threads);
+	}
+	stats.rides = rides ? rides->size() : 0;
+	return rides;
+}
+
+
+// Convenience function to compute the total cost and time in a RideVector.
+// Provide the RideVector as the first argument
+// The next two arguments will return the cost and time back to the caller.
+void sum_ride_vector
+(
+	const RideVector& rides,
+	int& total_cost,
+	double& total_time
+)
+{
+	total_cost = total_time = 0;
+	for (auto& ride : rides)
+	{
+		total_cost += ride->cost();
+		total_time += ride->time();
+	}
+}
+
+
+// Convenience function to print out each RideItem in a RideVector,
+// followed by the total kilocalories and protein in it.
+void print_ride_vector(const RideVector& rides)
+{
+	std::cout << "*** ride Vector ***" << std::endl;
+
+	if ( rides.size() == 0 )
+	{
+		std::cout << "[empty ride list]" << std::endl;
+	}
+	else
+	{
+		for (auto& ride : rides)
+		{
+			std::cout
+				<< "Ye olde " << ride->description()
+				<< " ==> "
+				<< "Cost of " << ride->cost() << " dollars"
+				<< "; time = " << ride->time()
+				<< std::endl
+				;
+		}
+
+		int total_cost;
+		double total_time;
+		sum_ride_vector(rides, total_cost, total_time);
+		std::cout
+			<< "> Grand total cost: " << total_cost << " dollars" << std::endl
+			<< "> Grand total time: " << total_time
+			<< std::endl
+			;
+	}
+}
+
+
+// Minutes as a whole number of hundredths of a minute, the fixed-point unit of the
+// dynamic algorithm in fixed_point_dynamic_max_time; saturates at the int32_t range.
+int32_t centiminutes(double minutes)
+{
+	double scaled = std::round(minutes * 100);
+	if (!(scaled > double(INT32_MIN)))
+	{
+		return std::isnan(scaled) ? 0 : INT32_MIN;
+	}
+	return scaled < double(INT32_MAX) ? int32_t(scaled) : INT32_MAX;
+}
+
+
+// Rides stored as columns: contiguous costs and times, and for each ride the id of its
+// description in a pool where every distinct description is stored once.
+// Solvers given a RideTable read the columns directly and answer with row numbers
+// (RideIndexList), so no RideItem is touched, or reference counted, along the way.
+class RideTable
+{
+	//
+	public:
+
+		//
+		RideTable() {}
+
+		//
+		explicit RideTable(const RideVector& rides)
+		{
+			reserve(rides.size());
+			for (auto& ride : rides)
+			{
+				add(ride->description(), ride->cost(), ride->time());
+			}
+		}
+
+		RideTable(const RideTable&) = delete;
+		RideTable& operator=(const RideTable&) = delete;
+
+		//
+		void reserve(size_t rows)
+		{
+			_costs.reserve(rows);
+			_times.reserve(rows);
+			_centiminutes.reserve(rows);
+			_description_ids.reserve(rows);
+		}
+
+		// Append a ride; returns its row.
+		size_t add(std::string_view description, int cost, double time)
+		{
+			_costs.push_back(cost);
+			_times.push_back(time);
+			_centiminutes.push_back(::centiminutes(time));
+			_description_ids.push_back(intern(description));
+			return _costs.size() - 1;
+		}
+
+		//
+		size_t size() const { return _costs.size(); }
+		bool empty() const { return _costs.empty(); }
+		int cost(size_t row) const { return _costs[row]; }
+		double time(size_t row) const { return _times[row]; }
+		int32_t centiminutes(size_t row) const { return _centiminutes[row]; }
+		const std::string& description(size_t row) const { return _descriptions[_description_ids[row]]; }
+		uint32_t description_id(size_t row) const { return _description_ids[row]; }
+
+		// Number of distinct descriptions.
+		size_t description_count() const { return _descriptions.size(); }
+
+		//
+		const int32_t* costs() const { return _costs.data(); }
+		const double* times() const { return _times.data(); }
+
+		// The times, rounded to centiminutes, for fixed_point_dynamic_max_time.
+		const int32_t* centiminute_times() const { return _centiminutes.data(); }
+
+		// Every row, in order.
+		RideIndexList rows() const
+		{
+			RideIndexList result(size());
+			std::iota(result.begin(), result.end(), size_t(0));
+			return result;
+		}
+
+		// RideItems for the given rows, in that order, e.g. to print a result.
+		std::unique_ptr<RideVector> select(const RideIndexList& rows) const
+		{
+			std::unique_ptr<RideVector> result(new RideVector);
+			result->reserve(rows.size());
+			for (size_t row : rows)
+			{
+				result->push_back(std::shared_ptr<RideItem>(new RideItem(description(row), cost(row), time(row))));
+			}
+			return result;
+		}
+
+	//
+	private:
+
+		//
+		uint32_t intern(std::string_view description)
+		{
+			auto found = _description_index.find(description);
+			if (found != _description_index.end())
+			{
+				return found->second;
+			}
+			uint32_t id = uint32_t(_descriptions.size());
+			_descriptions.emplace_back(description);
+			_description_index.emplace(std::string_view(_descriptions.back()), id);
+			return id;
+		}
+
+		//
+		std::vector<int32_t> _costs;
+		std::vector<double> _times;
+		std::vector<int32_t> _centiminutes;
+		std::vector<uint32_t> _description_ids;
+
+		// A deque never moves its strings, so the index can refer to them.
+		std::deque<std::string> _descriptions;
+		std::unordered_map<std::string_view, uint32_t> _description_index;
+};
+
+
+// sum_ride_vector for the given rows of table.
+void sum_ride_vector
+(
+	const RideTable& table,
+	const RideIndexList& rows,
+	int& total_cost,
+	double& total_time
+)
+{
+	total_cost = total_time = 0;
+	for (size_t row : rows)
+	{
+		total_cost += table.cost(row);
+		total_time += table.time(row);
+	}
+}
+
+
+// Dense table of cells for the dynamic algorithm, e.g. doubles, or int32_t centiminutes.
+// All cells live in one 64-byte aligned allocation; each row is padded to a whole number of
+// cache lines so that every row starts on a cache line. Cells start out zero.
+template <typename Cell>
+class BasicDpTable
+{
+	//
+	public:
+
+		// Bytes per cache line; rows and the allocation are aligned to this.
+		static constexpr size_t alignment = 64;
+
+		// The cells are allocated from resource.
+		BasicDpTable(size_t rows, size_t columns, std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+			:
+			_rows(rows),
+			_columns(columns),
+			_stride((columns + cells_per_line - 1) / cells_per_line * cells_per_line),
+			_cells(nullptr, CellsDelete { resource, _rows * _stride * sizeof(Cell) })
+		{
+			size_t bytes = _rows * _stride * sizeof(Cell);
+			if (bytes > 0)
+			{
+				_cells.reset(static_cast<Cell*>(resource->allocate(bytes, alignment)));
+				std::memset(_cells.get(), 0, bytes);
+			}
+		}
+
+		//
+		size_t rows() const { return _rows; }
+		size_t columns() const { return _columns; }
+
+		// Distance in cells between the starts of consecutive rows.
+		size_t stride() const { return _stride; }
+
+		// Row access, so that table[i][j] reads and writes cell (i, j).
+		Cell* operator[](size_t row) { return _cells.get() + row * _stride; }
+		const Cell* operator[](size_t row) const { return _cells.get() + row * _stride; }
+
+	//
+	private:
+
+		//
+		static constexpr size_t cells_per_line = alignment / sizeof(Cell);
+
+		//
+		struct CellsDelete
+		{
+			std::pmr::memory_resource* resource;
+			size_t bytes;
+			void operator()(Cell* cells) const { resource->deallocate(cells, bytes, alignment); }
+		};
+
+		//
+		size_t _rows, _columns, _stride;
+
+		//
+		std::unique_ptr<Cell[], CellsDelete> _cells;
+};
+
+
+// The table of the double-valued dynamic algorithm.
+typedef BasicDpTable<double> DpTable;
+
+
+// Convenience function to print out a 2D cache, composed of a DpTable
+// For sanity, will refuse to print a cache that is too large.
+// Hint: When running this program, you can redirect stdout to a file,
+//	which may be easier to view and inspect than a terminal
+void print_2d_cache(const DpTable& cache)
+{
+	std::cout << "*** 2D Cache ***" << std::endl;
+
+	if ( cache.rows() == 0 )
+	{
+		std::cout << "[empty]" << std::endl;
+	}
+	else if ( cache.rows() > 250 || cache.columns() > 250 )
+	{
+		std::cout << "[too large]" << std::endl;
+	}
+	else
+	{
+		for ( size_t i = 0; i < cache.rows(); i++ )
+		{
+			for ( size_t j = 0; j < cache.columns(); j++ )
+			{
+				std::cout << std::setw(5) << cache[i][j];
+			}
+			std::cout << std::endl;
+		}
+	}
+}
+
+// Filter the vector source, i.e. create and return a new RideVector containing the subset of
+// the ride items in source that match given criteria.
+// This is intended to:
+//	1) filter out ride with zero or negative time that are irrelevant to our optimization
+//	2) limit the size of inputs to the exhaustive search algorithm since it will probably be slow.
+//
+// Each ride item that is included must have at minimum min_time and at most max_time.
+//	(i.e., each included ride item's time must be between min_time and max_time (inclusive).
+//
+// In addition, the the vector includes only the first total_size ride items that match these criteria.
+std::unique_ptr<RideVector> filter_ride_vector
+(
+	const RideVector& source,
+	double min_time,
+	double max_time,
+	int total_size
+)
+{
+
+	std::unique_ptr<RideVector> filtered_rides(new RideVector);
+  std::shared_ptr<RideItem> element = nullptr;
+  for (auto element : source) {
+    if (element->time() >= min_time && element->time() <= max_time && element->time() > 0)
+  	  filtered_rides->push_back(element);
+  	if ((int)filtered_rides->size() >= total_size)
+  		break;
+  }
+	return filtered_rides;
+
+}
+
+
+// filter_ride_vector, reporting into stats.
+std::unique_ptr<RideVector> filter_ride_vector
+(
+	const RideVector& source,
+	double min_time,
+	double max_time,
+	int total_size,
+	QueryStats& stats
+)
+{
+	stats = QueryStats();
+	stats.engine = "filter";
+	std::unique_ptr<RideVector> filtered;
+	{
+		QueryStatsScope scope(stats);
+		filtered = filter_ride_vector(source, min_time, max_time, total_size);
+	}
+	stats.rides = filtered->size();
+	return filtered;
+}
+
+
+// filter_ride_vector over the rows of table, giving the rows that match.
+RideIndexList filter_ride_vector
+(
+	const RideTable& table,
+	double min_time,
+	double max_time,
+	int total_size
+)
+{
+	RideIndexList filtered;
+	const double* times = table.times();
+	for (size_t row = 0; row < table.size(); row++)
+	{
+		if (times[row] >= min_time && times[row] <= max_time && times[row] > 0)
+		{
+			filtered.push_back(row);
+		}
+		if (int(filtered.size()) >= total_size)
+		{
+			break;
+		}
+	}
+	return filtered;
+}
+
+// Index of one column of a RideTable for range queries: the rows sorted by key, and a merge
+// sort tree over that order, whose node for a run of sorted rows holds their row numbers in
+// ascending order. The rows with keys in [min, max] are a run of the sorted order, which the
+// tree covers with O(log n) nodes; merging those nodes yields the matching rows in table
+// order, so the first k of them cost O(log n + k log log n) however many rows match.
+// Takes O(n log n) time and memory to build.
+class RideRangeIndex
+{
+	//
+	public:
+
+		//
+		RideRangeIndex() {}
+
+		// An index of keys[0, n).
+		RideRangeIndex(const double* keys, size_t n)
+		{
+			std::vector<uint32_t> order(n);
+			std::iota(order.begin(), order.end(), uint32_t(0));
+			std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+			_sorted_keys.resize(n);
+			for (size_t i = 0; i < n; i++)
+			{
+				_sorted_keys[i] = keys[order[i]];
+			}
+
+			_levels.push_back(std::move(order));
+			for (size_t width = 1; width < n; width *= 2)
+			{
+				const std::vector<uint32_t>& below = _levels.back();
+				std::vector<uint32_t> level(n);
+				for (size_t start = 0; start < n; start += 2 * width)
+				{
+					size_t mid = std::min(n, start + width), end = std::min(n, start + 2 * width);
+					std::merge(below.begin() + start, below.begin() + mid, below.begin() + mid, below.begin() + end, level.begin() + start);
+				}
+				_levels.push_back(std::move(level));
+			}
+		}
+
+		//
+		size_t size() const { return _sorted_keys.size(); }
+
+		// Number of rows with keys in [min, max].
+		size_t count(double min, double max) const
+		{
+			size_t lo, hi;
+			key_range(min, max, lo, hi);
+			return hi - lo;
+		}
+
+		// The first k rows, in table order, with keys in [min, max].
+		RideIndexList first(double min, double max, size_t k) const
+		{
+			RideIndexList result;
+			size_t lo, hi;
+			key_range(min, max, lo, hi);
+			if (lo >= hi || k == 0)
+			{
+				return result;
+			}
+
+			// Cursors into the nodes covering [lo, hi), smallest row first
+			typedef std::pair<const uint32_t*, const uint32_t*> Cursor;
+			auto later = [](const Cursor& a, const Cursor& b) { return *a.first > *b.first; };
+			std::priority_queue<Cursor, std::vector<Cursor>, decltype(later)> cursors(later);
+			cover(_levels.size() - 1, 0, lo, hi, [&](const uint32_t* begin, const uint32_t* end) { cursors.push(Cursor(begin, end)); });
+
+			result.reserve(std::min(k, hi - lo));
+			while (!cursors.empty() && result.size() < k)
+			{
+				Cursor cursor = cursors.top();
+				cursors.pop();
+				result.push_back(*cursor.first);
+				if (++cursor.first != cursor.second)
+				{
+					cursors.push(cursor);
+				}
+			}
+			return result;
+		}
+
+	//
+	private:
+
+		// The run [lo, hi) of the sorted order with keys in [min, max].
+		void key_range(double min, double max, size_t& lo, size_t& hi) const
+		{
+			lo = std::lower_bound(_sorted_keys.begin(), _sorted_keys.end(), min) - _sorted_keys.begin();
+			hi = std::upper_bound(_sorted_keys.begin(), _sorted_keys.end(), max) - _sorted_keys.begin();
+			hi = std::max(lo, hi);
+		}
+
+		// Visit the rows of every node inside [lo, hi), starting from node block of level.
+		template <typename Visit>
+		void cover(size_t level, size_t block, size_t lo, size_t hi, const Visit& visit) const
+		{
+			size_t start = block << level, end = std::min(size(), (block + 1) << level);
+			if (end <= lo || hi <= start)
+			{
+				return;
+			}
+			if (lo <= start && end <= hi)
+			{
+				const uint32_t* rows = _levels[level].data();
+				visit(rows + start, rows + end);
+				return;
+			}
+			cover(level - 1, 2 * block, lo, hi, visit);
+			cover(level - 1, 2 * block + 1, lo, hi, visit);
+		}
+
+		// Keys in ascending order
+		std::vector<double> _sorted_keys;
+
+		// Level l holds the nodes for runs of 2^l sorted rows, back to back
+		std::vector<std::vector<uint32_t>> _levels;
+};
+
+
+// Range indexes on the time and cost columns of a RideTable, built once, e.g. at load time.
+// The table must not change afterwards.
+class RideTableIndex
+{
+	//
+	public:
+
+		//
+		explicit RideTableIndex(const RideTable& table)
+			:
+			_table(&table),
+			_time(table.times(), table.size())
+		{
+			std::vector<double> costs(table.costs(), table.costs() + table.size());
+			_cost = RideRangeIndex(costs.data(), costs.size());
+		}
+
+		//
+		const RideTable& table() const { return *_table; }
+		const RideRangeIndex& time() const { return _time; }
+		const RideRangeIndex& cost() const { return _cost; }
+
+		// The first k rows, in table order, that cost at most budget, e.g. to leave out
+		// rides that can never be afforded before solving.
+		RideIndexList affordable(int budget, size_t k = std::numeric_limits<size_t>::max()) const
+		{
+			return _cost.first(std::numeric_limits<double>::lowest(), budget, k);
+		}
+
+	//
+	private:
+
+		//
+		const RideTable* _table;
+		RideRangeIndex _time, _cost;
+};
+
+
+// filter_ride_vector over the rows of the indexed table, answered from the time index in time
+// logarithmic in the table size and linear in total_size, rather than with a scan.
+RideIndexList filter_ride_vector
+(
+	const RideTableIndex& index,
+	double min_time,
+	double max_time,
+	int total_size
+)
+{
+	// Rides with zero or negative time never match
+	double low = std::max(min_time, std::nextafter(0.0, 1.0));
+	if (total_size > 0)
+	{
+		return index.time().first(low, max_time, size_t(total_size));
+	}
+
+	// filter_ride_vector stops after the first ride when total_size is not positive
+	RideIndexList filtered;
+	const RideTable& table = index.table();
+	if (!table.empty() && table.time(0) >= low && table.time(0) <= max_time)
+	{
+		filtered.push_back(0);
+	}
+	return filtered;
+}
+
+
+// The rides at the given positions, in that order.
+std::unique_ptr<RideVector> select_rides(const RideVector& rides, const RideIndexList& chosen)
+{
+	std::unique_ptr<RideVector> result(new RideVector);
+	result->reserve(chosen.size());
+	for (size_t i : chosen)
+	{
+		result->push_back(rides[i]);
+	}
+	return result;
+}
+
+
+// A lazy filter_ride_vector: a source RideVector and a chain of filters, each applied to the
+// output of the one before, that are only evaluated when the view is read. Reading the view
+// gives the same rides, in the same order, as calling filter_ride_vector once per filter,
+// including its total_size handling, but no intermediate RideVector is built and no
+// reference count is touched; the solvers take a view directly.
+// The source must outlive the view.
+class RideFilterView
+{
+	//
+	public:
+
+		// Every ride of source.
+		explicit RideFilterView(const RideVector& source) : _source(&source) {}
+
+		// This view, further filtered as filter_ride_vector would.
+		RideFilterView filter(double min_time, double max_time, int total_size) const
+		{
+			RideFilterView result(*this);
+			result._stages.push_back(Stage { min_time, max_time, total_size });
+			return result;
+		}
+
+		//
+		const RideVector& source() const { return *_source; }
+
+		// Positions in source of the first limit rides of the view, in order.
+		RideIndexList indices(size_t limit = std::numeric_limits<size_t>::max()) const
+		{
+			RideIndexList result;
+			std::vector<int> counts(_stages.size(), 0);
+			for (size_t i = 0; i < _source->size() && result.size() < limit; i++)
+			{
+				double time = (*_source)[i]->time();
+				bool passed = true, stopped = false;
+				for (size_t k = 0; k < _stages.size() && passed; k++)
+				{
+					const Stage& stage = _stages[k];
+					passed = time >= stage.min_time && time <= stage.max_time && time > 0;
+					counts[k] += passed;
+
+					// Filter k has all it wants once it has this many, including when this ride
+					// fails it; the ride still goes through the filters after k first.
+					stopped = stopped || counts[k] >= stage.total_size;
+				}
+				if (passed)
+				{
+					result.push_back(i);
+				}
+				if (stopped)
+				{
+					break;
+				}
+			}
+			return result;
+		}
+
+		// Number of rides in the view.
+		size_t size() const { return indices().size(); }
+
+		// The rides of the view as a RideVector, equal to the output of the chained filters.
+		std::unique_ptr<RideVector> materialize() const
+		{
+			return select_rides(*_source, indices());
+		}
+
+	//
+	private:
+
+		//
+		struct Stage
+		{
+			double min_time, max_time;
+			int total_size;
+		};
+
+		//
+		const RideVector* _source;
+		std::vector<Stage> _stages;
+};
+
+
+// A view of source filtered as by filter_ride_vector.
+RideFilterView filter_ride_view
+(
+	const RideVector& source,
+	double min_time,
+	double max_time,
+	int total_size
+)
+{
+	return RideFilterView(source).filter(min_time, max_time, total_size);
+}
+
+
+// Asks a solver to stop early, either when cancel() is called, from any thread, or once a
+// deadline passes. Solvers that take a token check it between rows or blocks of subsets and
+// then return the best plan they know of.
+class CancellationToken
+{
+	//
+	public:
+
+		// A token that only stops when cancelled.
+		CancellationToken()
+			:
+			_cancelled(false),
+			_deadline(std::chrono::steady_clock::time_point::max())
+		{}
+
+		// A token that also stops seconds from now.
+		explicit CancellationToken(double seconds)
+			:
+			_cancelled(false),
+			_deadline(std::chrono::steady_clock::now()
+				+ std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds)))
+		{}
+
+		CancellationToken(const CancellationToken&) = delete;
+		CancellationToken& operator=(const CancellationToken&) = delete;
+
+		//
+		void cancel() { _cancelled.store(true, std::memory_order_relaxed); }
+
+		// Whether the solver should stop.
+		bool is_cancelled() const
+		{
+			return _cancelled.load(std::memory_order_relaxed)
+				|| (_deadline != std::chrono::steady_clock::time_point::max()
+					&& std::chrono::steady_clock::now() >= _deadline);
+		}
+
+	//
+	private:
+
+		//
+		std::atomic<bool> _cancelled;
+		std::chrono::steady_clock::time_point _deadline;
+};
+
+
+// How far a solver given a CancellationToken got.
+struct AnytimeStats
+{
+	// Whether it ran to completion, so the plan is the one the solver gives without a token
+	bool complete = false;
+
+	// Fraction of the work done, from 0 to 1
+	double progress = 0;
+};
+
+
+// Strategy used by dynamic_max_time to hold the DP state and reconstruct the chosen rides.
+enum class DynamicStrategy
+{
+	// Keep the whole (n+1) x (budget+2) table of doubles in a DpTable.
+	// Simple, but needs 8 bytes per cell.
+	full_table,
+
+	// Keep a single row of doubles, updated in place with the budget iterating downward,
+	// and record each take/skip decision in a packed bitset for the reconstruction.
+	// Needs 1 bit per cell plus one row.
+	rolling_row,
+
+	// Keep no decisions at all: split the rides in half, run the forward DP over the lower
+	// half, recurse on the upper half to learn the budget left at the split point, then
+	// recurse on the lower half with that budget.
+	// Needs O(budget * log n) doubles, at the price of O(n * budget * log n) time.
+	divide_and_conquer,
+
+	// rolling_row, or divide_and_conquer once the decision bitset would get too large.
+	automatic
+};
+
+
+// Implementation of the inner loop of the dynamic algorithm, selected by DynamicOptions::kernel.
+enum class KnapsackKernel
+{
+	// The fastest kernel this CPU supports
+	automatic,
+
+	// Portable one-cell-at-a-time loop
+	scalar,
+
+	// 4 doubles per step; x86 only
+	avx2,
+
+	// 8 doubles per step; x86 only
+	avx512,
+
+	// 2 doubles per step; AArch64 only
+	neon
+};
+
+
+// Tuning knobs for dynamic_max_time.
+struct DynamicOptions
+{
+	// How to store the DP state; every strategy returns the same rides in the same order.
+	DynamicStrategy strategy = DynamicStrategy::automatic;
+
+	// With DynamicStrategy::automatic, problems with more than this many
+	// n x (budget + 1) cells use divide_and_conquer instead of rolling_row.
+	// The default caps the decision bitset at 512 MiB.
+	size_t divide_and_conquer_cells = size_t(1) << 32;
+
+	// Inner loop implementation; every kernel computes bit-identical rows.
+	KnapsackKernel kernel = KnapsackKernel::automatic;
+};
+
+
+// Packed take/skip decisions of the dynamic algorithm; one bit per (ride, budget) cell.
+// Bit (i, j) is set when ride i was taken at budget j, i.e. when row i+1 of the full table
+// differs from row i at column j.
+class DecisionBitset
+{
+	//
+	public:
+
+		// The words are allocated from resource.
+		DecisionBitset(size_t rows, size_t columns, std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+			:
+			_words_per_row((columns + 63) / 64),
+			_words(rows * _words_per_row, 0, resource)
+		{}
+
+		//
+		void set(size_t row, size_t column)
+		{
+			_words[row * _words_per_row + column / 64] |= uint64_t(1) << (column % 64);
+		}
+
+		//
+		bool test(size_t row, size_t column) const
+		{
+			return (_words[row * _words_per_row + column / 64] >> (column % 64)) & 1;
+		}
+
+		// The words holding one row of decisions, for the row kernels.
+		uint64_t* row(size_t row) { return _words.data() + row * _words_per_row; }
+
+	//
+	private:
+
+		// Number of 64-bit words holding one row of decisions
+		size_t _words_per_row;
+
+		// All rows, back to back
+		std::pmr::vector<uint64_t> _words;
+};
+
+
+// One row update of the dynamic algorithm, for a ride of the given cost and time:
+//	next[j] = max(time + previous[j - cost], previous[j])	for max(first, cost) <= j <= last
+//	next[j] = previous[j]									for first <= j < cost
+// When taken is non-null, bit j of taken is set wherever the first term is strictly greater,
+// i.e. wherever the ride is taken. previous and next may be the same row, in which case the
+// copy region is skipped and the max region is updated in place from the top down.
+typedef void (*KnapsackRowKernel)
+(
+	const double* previous,
+	double* next,
+	uint64_t* taken,
+	int first,
+	int last,
+	int cost,
+	double time
+);
+
+
+// Copy region of a KnapsackRowKernel; returns the first column of the max region.
+template <typename Cell>
+int knapsack_row_copy(const Cell* previous, Cell* next, int first, int last, int cost)
+{
+	int low = std::max(first, cost);
+	if (previous != next && low > first)
+	{
+		std::memcpy(next + first, previous + first, (std::min(low, last + 1) - first) * sizeof(Cell));
+	}
+	return low;
+}
+
+
+// OR the lanes bits of mask into taken, starting from bit column.
+void knapsack_set_taken(uint64_t* taken, int column, uint64_t mask, int lanes)
+{
+	size_t word = column / 64;
+	int shift = column % 64;
+	taken[word] |= mask << shift;
+	if (shift + lanes > 64)
+	{
+		taken[word + 1] |= mask >> (64 - shift);
+	}
+}
+
+
+// Max region of a KnapsackRowKernel, one cell at a time, from column high down to low.
+template <typename Cell>
+void knapsack_row_scalar_cells
+(
+	const Cell* previous,
+	Cell* next,
+	uint64_t* taken,
+	int low,
+	int high,
+	int cost,
+	Cell time
+)
+{
+	for (int j = high; j >= low; j--)
+	{
+		Cell with = time + previous[j - cost];
+		Cell without = previous[j];
+		if (with > without)
+		{
+			next[j] = with;
+			if (taken)
+			{
+				taken[j / 64] |= uint64_t(1) << (j % 64);
+			}
+		}
+		else
+		{
+			next[j] = without;
+		}
+	}
+}
+
+
+// KnapsackKernel::scalar
+void knapsack_row_scalar
+(
+	const double* previous,
+	double* next,
+	uint64_t* taken,
+	int first,
+	int last,
+	int cost,
+	double time
+)
+{
+	int low = knapsack_row_copy(previous, next, first, last, cost);
+	knapsack_row_scalar_cells(previous, next, taken, low, last, cost, time);
+}
+
+
+// The vector kernels below process whole blocks from the top of the max region down, and
+// leave the remainder at the bottom to the scalar loop. Each block loads all of its inputs
+// before storing, and only ever reads columns below the block's end, so the in-place update
+// stays correct for any cost.
+
+#ifdef MAXTIME_X86_KERNELS
+
+// KnapsackKernel::avx2
+__attribute__((target("avx2")))
+void knapsack_row_avx2
+(
+	const double* previous,
+	double* next,
+	uint64_t* taken,
+	int first,
+	int last,
+	int cost,
+	double time
+)
+{
+	int low = knapsack_row_copy(previous, next, first, last, cost);
+	__m256d times = _mm256_set1_pd(time);
+	int j = last + 1;
+	for ( ; j - 4 >= low; j -= 4)
+	{
+		__m256d without = _mm256_loadu_pd(previous + j - 4);
+		__m256d with = _mm256_add_pd(times, _mm256_loadu_pd(previous + j - 4 - cost));
+		__m256d greater = _mm256_cmp_pd(with, without, _CMP_GT_OQ);
+		_mm256_storeu_pd(next + j - 4, _mm256_blendv_pd(without, with, greater));
+		if (taken)
+		{
+			uint64_t mask = _mm256_movemask_pd(greater);
+			if (mask)
+			{
+				knapsack_set_taken(taken, j - 4, mask, 4);
+			}
+		}
+	}
+	knapsack_row_scalar_cells(previous, next, taken, low, j - 1, cost, time);
+}
+
+
+// KnapsackKernel::avx512
+__attribute__((target("avx512f")))
+void knapsack_row_avx512
+(
+	const double* previous,
+	double* next,
+	uint64_t* taken,
+	int first,
+	int last,
+	int cost,
+	double time
+)
+{
+	int low = knapsack_row_copy(previous, next, first, last, cost);
+	__m512d times = _mm512_set1_pd(time);
+	int j = last + 1;
+	for ( ; j - 8 >= low; j -= 8)
+	{
+		__m512d without = _mm512_loadu_pd(previous + j - 8);
+		__m512d with = _mm512_add_pd(times, _mm512_loadu_pd(previous + j - 8 - cost));
+		__mmask8 greater = _mm512_cmp_pd_mask(with, without, _CMP_GT_OQ);
+		_mm512_storeu_pd(next + j - 8, _mm512_mask_blend_pd(greater, without, with));
+		if (taken && greater)
+		{
+			knapsack_set_taken(taken, j - 8, greater, 8);
+		}
+	}
+	knapsack_row_scalar_cells(previous, next, taken, low, j - 1, cost, time);
+}
+
+#endif
+
+
+#ifdef MAXTIME_NEON_KERNELS
+
+// KnapsackKernel::neon
+void knapsack_row_neon
+(
+	const double* previous,
+	double* next,
+	uint64_t* taken,
+	int first,
+	int last,
+	int cost,
+	double time
+)
+{
+	int low = knapsack_row_copy(previous, next, first, last, cost);
+	float64x2_t times = vdupq_n_f64(time);
+	int j = last + 1;
+	for ( ; j - 2 >= low; j -= 2)
+	{
+		float64x2_t without = vld1q_f64(previous + j - 2);
+		float64x2_t with = vaddq_f64(times, vld1q_f64(previous + j - 2 - cost));
+		uint64x2_t greater = vcgtq_f64(with, without);
+		vst1q_f64(next + j - 2, vbslq_f64(greater, with, without));
+		if (taken)
+		{
+			uint64_t mask = (vgetq_lane_u64(greater, 0) & 1) | (vgetq_lane_u64(greater, 1) & 2);
+			if (mask)
+			{
+				knapsack_set_taken(taken, j - 2, mask, 2);
+			}
+		}
+	}
+	knapsack_row_scalar_cells(previous, next, taken, low, j - 1, cost, time);
+}
+
+#endif
+
+
+// Whether this build and CPU can run the given kernel.
+bool knapsack_kernel_supported(KnapsackKernel kernel)
+{
+	switch (kernel)
+	{
+		case KnapsackKernel::automatic:
+		case KnapsackKernel::scalar:
+			return true;
+#ifdef MAXTIME_X86_KERNELS
+		case KnapsackKernel::avx2:
+			return __builtin_cpu_supports("avx2");
+		case KnapsackKernel::avx512:
+			return __builtin_cpu_supports("avx512f");
+#endif
+#ifdef MAXTIME_NEON_KERNELS
+		case KnapsackKernel::neon:
+			return true;
+#endif
+		default:
+			return false;
+	}
+}
+
+
+// The row kernel for the given choice; automatic, and kernels this CPU can't run, resolve
+// to the fastest supported one.
+KnapsackRowKernel knapsack_row_kernel(KnapsackKernel kernel)
+{
+	if (kernel == KnapsackKernel::automatic || !knapsack_kernel_supported(kernel))
+	{
+		static const KnapsackKernel fastest =
+			knapsack_kernel_supported(KnapsackKernel::avx512) ? KnapsackKernel::avx512
+			: knapsack_kernel_supported(KnapsackKernel::avx2) ? KnapsackKernel::avx2
+			: knapsack_kernel_supported(KnapsackKernel::neon) ? KnapsackKernel::neon
+			: KnapsackKernel::scalar;
+		kernel = fastest;
+	}
+
+	switch (kernel)
+	{
+#ifdef MAXTIME_X86_KERNELS
+		case KnapsackKernel::avx2:
+			return knapsack_row_avx2;
+		case KnapsackKernel::avx512:
+			return knapsack_row_avx512;
+#endif
+#ifdef MAXTIME_NEON_KERNELS
+		case KnapsackKernel::neon:
+			return knapsack_row_neon;
+#endif
+		default:
+			return knapsack_row_scalar;
+	}
+}
+
+
+// A KnapsackRowKernel over fixed-point times, e.g. centiminutes. With 32-bit cells each
+// vector step covers twice the columns of the double kernels, and the table takes half the
+// memory.
+typedef void (*FixedPointRowKernel)
+(
+	const int32_t* previous,
+	int32_t* next,
+	uint64_t* taken,
+	int first,
+	int last,
+	int cost,
+	int32_t time
+);
+
+
+// KnapsackKernel::scalar, over fixed-point times
+void fixed_point_row_scalar
+(
+	const int32_t* previous,
+	int32_t* next,
+	uint64_t* taken,
+	int first,
+	int last,
+	int cost,
+	int32_t time
+)
+{
+	int low = knapsack_row_copy(previous, next, first, last, cost);
+	knapsack_row_scalar_cells(previous, next, taken, low, last, cost, time);
+}
+
+
+#ifdef MAXTIME_X86_KERNELS
+
+// KnapsackKernel::avx2, over fixed-point times; 8 cells per step
+__attribute__((target("avx2")))
+void fixed_point_row_avx2
+(
+	const int32_t* previous,
+	int32_t* next,
+	uint64_t* taken,
+	int first,
+	int last,
+	int cost,
+	int32_t time
+)
+{
+	int low = knapsack_row_copy(previous, next, first, last, cost);
+	__m256i times = _mm256_set1_epi32(time);
+	int j = last + 1;
+	for ( ; j - 8 >= low; j -= 8)
+	{
+		__m256i without = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(previous + j - 8));
+		__m256i with = _mm256_add_epi32(times, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(previous + j - 8 - cost)));
+		__m256i greater = _mm256_cmpgt_epi32(with, without);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(next + j - 8), _mm256_blendv_epi8(without, with, greater));
+		if (taken)
+		{
+			uint64_t mask = _mm256_movemask_ps(_mm256_castsi256_ps(greater));
+			if (mask)
+			{
+				knapsack_set_taken(taken, j - 8, mask, 8);
+			}
+		}
+	}
+	knapsack_row_scalar_cells(previous, next, taken, low, j - 1, cost, time);
+}
+
+
+// KnapsackKernel::avx512, over fixed-point times; 16 cells per step
+__attribute__((target("avx512f")))
+void fixed_point_row_avx512
+(
+	const int32_t* previous,
+	int32_t* next,
+	uint64_t* taken,
+	int first,
+	int last,
+	int cost,
+	int32_t time
+)
+{
+	int low = knapsack_row_copy(previous, next, first, last, cost);
+	__m512i times = _mm512_set1_epi32(time);
+	int j = last + 1;
+	for ( ; j - 16 >= low; j -= 16)
+	{
+		__m512i without = _mm512_loadu_si512(previous + j - 16);
+		__m512i with = _mm512_add_epi32(times, _mm512_loadu_si512(previous + j - 16 - cost));
+		__mmask16 greater = _mm512_cmpgt_epi32_mask(with, without);
+		_mm512_storeu_si512(next + j - 16, _mm512_mask_blend_epi32(greater, without, with));
+		if (taken && greater)
+		{
+			knapsack_set_taken(taken, j - 16, greater, 16);
+		}
+	}
+	knapsack_row_scalar_cells(previous, next, taken, low, j - 1, cost, time);
+}
+
+#endif
+
+
+#ifdef MAXTIME_NEON_KERNELS
+
+// KnapsackKernel::neon, over fixed-point times; 4 cells per step
+void fixed_point_row_neon
+(
+	const int32_t* previous,
+	int32_t* next,
+	uint64_t* taken,
+	int first,
+	int last,
+	int cost,
+	int32_t time
+)
+{
+	int low = knapsack_row_copy(previous, next, first, last, cost);
+	int32x4_t times = vdupq_n_s32(time);
+	int j = last + 1;
+	for ( ; j - 4 >= low; j -= 4)
+	{
+		int32x4_t without = vld1q_s32(previous + j - 4);
+		int32x4_t with = vaddq_s32(times, vld1q_s32(previous + j - 4 - cost));
+		uint32x4_t greater = vcgtq_s32(with, without);
+		vst1q_s32(next + j - 4, vbslq_s32(greater, with, without));
+		if (taken)
+		{
+			static const uint32_t lanes[4] = { 1, 2, 4, 8 };
+			uint64_t mask = vaddvq_u32(vandq_u32(greater, vld1q_u32(lanes)));
+			if (mask)
+			{
+				knapsack_set_taken(taken, j - 4, mask, 4);
+			}
+		}
+	}
+	knapsack_row_scalar_cells(previous, next, taken, low, j - 1, cost, time);
+}
+
+#endif
+
+
+// The fixed-point row kernel for the given choice, resolved as by knapsack_row_kernel.
+FixedPointRowKernel fixed_point_row_kernel(KnapsackKernel kernel)
+{
+	KnapsackRowKernel resolved = knapsack_row_kernel(kernel);
+#ifdef MAXTIME_X86_KERNELS
+	if (resolved == knapsack_row_avx2)
+	{
+		return fixed_point_row_avx2;
+	}
+	if (resolved == knapsack_row_avx512)
+	{
+		return fixed_point_row_avx512;
+	}
+#endif
+#ifdef MAXTIME_NEON_KERNELS
+	if (resolved == knapsack_row_neon)
+	{
+		return fixed_point_row_neon;
+	}
+#endif
+	return fixed_point_row_scalar;
+}
+
+
+// The rides given to the dynamic algorithm, as flat arrays of costs and times.
+// The costs and the budget are divided by the greatest common divisor of the costs. Every
+// budget the traceback visits is then total_cost minus a multiple of the divisor, and
+// column j of the full table equals column j / divisor of the reduced one, cell for cell,
+// so the reduced problem takes exactly the same rides with a table divisor times narrower.
+struct DynamicProblem
+{
+	// Where the solvers allocate their working memory and result
+	std::pmr::memory_resource* resource = std::pmr::get_default_resource();
+
+	std::pmr::vector<int> costs { resource };
+	std::pmr::vector<double> times { resource };
+
+	// The budget, divided by cost_gcd
+	int total_cost;
+
+	// What the costs and budget were divided by
+	int cost_gcd;
+};
+
+
+// Greatest common divisor of the costs of rides; 1 for no rides.
+int ride_cost_gcd(const RideVector& rides)
+{
+	int divisor = 0;
+	for (auto& ride : rides)
+	{
+		divisor = std::gcd(divisor, ride->cost());
+	}
+	return divisor > 0 ? divisor : 1;
+}
+
+
+// The DynamicProblem for the given rides and budget, allocating from resource.
+DynamicProblem dynamic_problem
+(
+	const RideVector& rides,
+	int total_cost,
+	std::pmr::memory_resource* resource = std::pmr::get_default_resource()
+)
+{
+	DynamicProblem problem { resource };
+	problem.cost_gcd = ride_cost_gcd(rides);
+	problem.total_cost = total_cost < 0 ? -1 : total_cost / problem.cost_gcd;
+	problem.costs.reserve(rides.size());
+	problem.times.reserve(rides.size());
+	for (auto& ride : rides)
+	{
+		problem.costs.push_back(ride->cost() / problem.cost_gcd);
+		problem.times.push_back(ride->time());
+	}
+	return problem;
+}
+
+
+// The DynamicProblem for the given rows of table and budget, allocating from resource.
+DynamicProblem dynamic_problem
+(
+	const RideTable& table,
+	const RideIndexList& rows,
+	int total_cost,
+	std::pmr::memory_resource* resource = std::pmr::get_default_resource()
+)
+{
+	DynamicProblem problem { resource };
+	int divisor = 0;
+	for (size_t row : rows)
+	{
+		divisor = std::gcd(divisor, table.cost(row));
+	}
+	problem.cost_gcd = divisor > 0 ? divisor : 1;
+	problem.total_cost = total_cost < 0 ? -1 : total_cost / problem.cost_gcd;
+	problem.costs.reserve(rows.size());
+	problem.times.reserve(rows.size());
+	for (size_t row : rows)
+	{
+		problem.costs.push_back(table.cost(row) / problem.cost_gcd);
+		problem.times.push_back(table.time(row));
+	}
+	return problem;
+}
+
+
+// The DynamicProblem for the rides at the given positions, and budget.
+DynamicProblem dynamic_problem(const RideVector& rides, const RideIndexList& positions, int total_cost)
+{
+	DynamicProblem problem;
+	int divisor = 0;
+	for (size_t i : positions)
+	{
+		divisor = std::gcd(divisor, rides[i]->cost());
+	}
+	problem.cost_gcd = divisor > 0 ? divisor : 1;
+	problem.total_cost = total_cost < 0 ? -1 : total_cost / problem.cost_gcd;
+	problem.costs.reserve(positions.size());
+	problem.times.reserve(positions.size());
+	for (size_t i : positions)
+	{
+		problem.costs.push_back(rides[i]->cost() / problem.cost_gcd);
+		problem.times.push_back(rides[i]->time());
+	}
+	return problem;
+}
+
+
+// Map positions within rows back to rows of the table.
+RideIndexList table_rows(const RideIndexList& rows, RideIndexList&& positions)
+{
+	for (size_t& position : positions)
+	{
+		position = rows[position];
+	}
+	return std::move(positions);
+}
+
+
+// Walk taken from the last ride to the first, starting from budget, which is in the units of
+// problem.total_cost and at most that.
+RideIndexList dynamic_traceback(const DynamicProblem& problem, const DecisionBitset& taken, int budget)
+{
+	RideIndexList chosen(problem.resource);
+	int remaining = budget;
+	for (size_t i = problem.costs.size(); i > 0; i--)
+	{
+		if (taken.test(i - 1, remaining))
+		{
+			chosen.push_back(i - 1);
+			remaining -= problem.costs[i - 1];
+		}
+	}
+	return chosen;
+}
+
+
+// Walk taken from the last ride to the first, starting from the whole budget.
+RideIndexList dynamic_traceback(const DynamicProblem& problem, const DecisionBitset& taken)
+{
+	return dynamic_traceback(problem, taken, problem.total_cost);
+}
+
+
+// Full table strategy of dynamic_max_time; see DynamicStrategy::full_table.
+RideIndexList dynamic_full_table(const DynamicProblem& problem, KnapsackRowKernel kernel)
+{
+	RideIndexList chosen(problem.resource);
+	int total_cost = problem.total_cost;
+	if (total_cost < 0)
+	{
+		return chosen;
+	}
+
+	size_t n = problem.costs.size();
+	MAXTIME_PHASE(phase, "allocate");
+	DpTable cache(n + 1, total_cost + 2, problem.resource);
+	MAXTIME_NEXT_PHASE(phase, "fill");
+	for (size_t i = 1; i <= n; i++)
+	{
+		kernel(cache[i - 1], cache[i], nullptr, 1, total_cost, problem.costs[i - 1], problem.times[i - 1]);
+	}
+
+	MAXTIME_NEXT_PHASE(phase, "traceback");
+	int remaining = total_cost;
+	for (size_t i = n; i > 0; i--)
+	{
+		if (cache[i][remaining] != cache[i - 1][remaining])
+		{
+			chosen.push_back(i - 1);
+			remaining -= problem.costs[i - 1];
+		}
+	}
+
+	return chosen;
+}
+
+
+// Rolling row strategy of dynamic_max_time; see DynamicStrategy::rolling_row.
+// Iterating the budget downward lets row i overwrite row i-1 in place, since cell j only
+// reads cells j and j - cost of the previous row.
+RideIndexList dynamic_rolling_row(const DynamicProblem& problem, KnapsackRowKernel kernel)
+{
+	if (problem.total_cost < 0)
+	{
+		return RideIndexList(problem.resource);
+	}
+
+	size_t n = problem.costs.size();
+	MAXTIME_PHASE(phase, "allocate");
+	std::pmr::vector<double> best(problem.total_cost + 1, 0.0, problem.resource);
+	DecisionBitset taken(n, problem.total_cost + 1, problem.resource);
+	MAXTIME_NEXT_PHASE(phase, "fill");
+	for (size_t i = 0; i < n; i++)
+	{
+		kernel(best.data(), best.data(), taken.row(i), 0, problem.total_cost, problem.costs[i], problem.times[i]);
+	}
+
+	MAXTIME_NEXT_PHASE(phase, "traceback");
+	return dynamic_traceback(problem, taken);
+}
+
+
+// One row of the dynamic algorithm, allocated from the resource of its problem.
+typedef std::pmr::vector<double> DynamicRow;
+
+
+// Advances row, holding columns [0, capacity] of row lo of the full table, to row hi.
+typedef std::function<void(DynamicRow& row, size_t lo, size_t hi, int capacity)> DynamicForwardPass;
+
+
+// Recursive step of the divide and conquer strategy of dynamic_max_time.
+// base holds row lo of the full table, at least up to column capacity, and capacity is the
+// budget left when the traceback reaches row hi.
+// Appends the rides taken among [lo, hi) to chosen, last ride first, and returns the
+// budget left when the traceback reaches row lo.
+// Once *stopped is set, e.g. by forward, no more rows are allocated or computed and the
+// recursion unwinds; chosen then holds the rides taken among the rides decided so far.
+int dynamic_divide_and_conquer_rows
+(
+	const DynamicProblem& problem,
+	size_t lo,
+	size_t hi,
+	const DynamicRow& base,
+	int capacity,
+	const DynamicForwardPass& forward,
+	RideIndexList& chosen,
+	const bool* stopped = nullptr
+)
+{
+	if (stopped && *stopped)
+	{
+		return capacity;
+	}
+	if (hi - lo == 1)
+	{
+		int cost = problem.costs[lo];
+		if (capacity >= cost && problem.times[lo] + base[capacity - cost] > base[capacity])
+		{
+			chosen.push_back(lo);
+			return capacity - cost;
+		}
+		return capacity;
+	}
+
+	size_t mid = lo + (hi - lo) / 2;
+	{
+		// Row mid, computed the same way as the full table so the comparisons agree exactly
+		DynamicRow row(base.begin(), base.begin() + capacity + 1, problem.resource);
+		forward(row, lo, mid, capacity);
+		capacity = dynamic_divide_and_conquer_rows(problem, mid, hi, row, capacity, forward, chosen, stopped);
+	}
+	return dynamic_divide_and_conquer_rows(problem, lo, mid, base, capacity, forward, chosen, stopped);
+}
+
+
+// Divide and conquer strategy of dynamic_max_time; see DynamicStrategy::divide_and_conquer.
+// forward computes the intermediate rows; see dynamic_divide_and_conquer_rows for stopped.
+RideIndexList dynamic_divide_and_conquer
+(
+	const DynamicProblem& problem,
+	const DynamicForwardPass& forward,
+	const bool* stopped = nullptr
+)
+{
+	RideIndexList chosen(problem.resource);
+	if (problem.total_cost < 0 || problem.costs.empty())
+	{
+		return chosen;
+	}
+
+	MAXTIME_PHASE(phase, "divide_and_conquer");
+	DynamicRow base(problem.total_cost + 1, 0.0, problem.resource);
+	dynamic_divide_and_conquer_rows(problem, 0, problem.costs.size(), base, problem.total_cost, forward, chosen, stopped);
+	return chosen;
+}
+
+
+// Rows the forward passes of dynamic_divide_and_conquer compute for the rides [lo, hi),
+// when it runs to completion.
+size_t dynamic_divide_and_conquer_row_count(size_t lo, size_t hi)
+{
+	if (hi - lo <= 1)
+	{
+		return 0;
+	}
+	size_t mid = lo + (hi - lo) / 2;
+	return (mid - lo) + dynamic_divide_and_conquer_row_count(mid, hi) + dynamic_divide_and_conquer_row_count(lo, mid);
+}
+
+
+// The forward pass of the serial divide and conquer strategy.
+DynamicForwardPass dynamic_serial_forward(const DynamicProblem& problem, KnapsackRowKernel kernel)
+{
+	return [&problem, kernel](DynamicRow& row, size_t lo, size_t hi, int capacity)
+	{
+		for (size_t i = lo; i < hi; i++)
+		{
+			kernel(row.data(), row.data(), nullptr, 0, capacity, problem.costs[i], problem.times[i]);
+		}
+	};
+}
+
+
+// The strategy options asks for, with automatic resolved for the given problem.
+DynamicStrategy dynamic_strategy(const DynamicProblem& problem, const DynamicOptions& options)
+{
+	if (options.strategy != DynamicStrategy::automatic)
+	{
+		return options.strategy;
+	}
+	double cells = double(problem.costs.size()) * (double(std::max(problem.total_cost, 0)) + 1);
+	return cells > double(options.divide_and_conquer_cells)
+		? DynamicStrategy::divide_and_conquer
+		: DynamicStrategy::rolling_row;
+}
+
+
+// Name of strategy, for reports.
+const char* dynamic_strategy_name(DynamicStrategy strategy)
+{
+	switch (strategy)
+	{
+		case DynamicStrategy::full_table:
+			return "full_table";
+		case DynamicStrategy::rolling_row:
+			return "rolling_row";
+		case DynamicStrategy::divide_and_conquer:
+			return "divide_and_conquer";
+		default:
+			return "automatic";
+	}
+}
+
+
+// The dynamic algorithm on a prepared problem; see dynamic_max_time.
+RideIndexList dynamic_select(const DynamicProblem& problem, const DynamicOptions& options)
+{
+	KnapsackRowKernel kernel = knapsack_row_kernel(options.kernel);
+	switch (dynamic_strategy(problem, options))
+	{
+		case DynamicStrategy::divide_and_conquer:
+			return dynamic_divide_and_conquer(problem, dynamic_serial_forward(problem, kernel));
+		case DynamicStrategy::rolling_row:
+			return dynamic_rolling_row(problem, kernel);
+		case DynamicStrategy::full_table:
+		default:
+			return dynamic_full_table(problem, kernel);
+	}
+}
+
+
+// Compute the optimal set of ride items with a dynamic algorithm.
+// Specifically, among the ride items that fit within a total_cost budget,
+// choose the selection of rides whose time is greatest.
+// Repeat until no more ride items can be chosen, either because we've run out of ride items,
+// or run out of dollars.
+// The rides are returned last-considered first; options.strategy only changes how much
+// memory is used along the way.
+std::unique_ptr<RideVector> dynamic_max_time
+(
+	const RideVector& rides,
+	int total_cost,
+	const DynamicOptions& options = DynamicOptions()
+)
+{
+	return select_rides(rides, dynamic_select(dynamic_problem(rides, total_cost), options));
+}
+
+
+// dynamic_max_time, reporting into stats. The cells are those of the DP table, or all those
+// of the forward passes with the divide and conquer strategy; the working memory is counted
+// from the first allocation of the table to the traceback.
+std::unique_ptr<RideVector> dynamic_max_time
+(
+	const RideVector& rides,
+	int total_cost,
+	QueryStats& stats,
+	const DynamicOptions& options = DynamicOptions()
+)
+{
+	stats = QueryStats();
+	CountingResource counting;
+	std::unique_ptr<RideVector> result;
+	{
+		QueryStatsScope scope(stats);
+		MAXTIME_PHASE(phase, "problem");
+		DynamicProblem problem = dynamic_problem(rides, total_cost, &counting);
+		DynamicStrategy strategy = dynamic_strategy(problem, options);
+		stats.engine = std::string("dynamic/") + dynamic_strategy_name(strategy);
+
+		MAXTIME_NEXT_PHASE(phase, "solve");
+		RideIndexList chosen(&counting);
+		if (strategy == DynamicStrategy::divide_and_conquer)
+		{
+			DynamicForwardPass forward = dynamic_serial_forward(problem, knapsack_row_kernel(options.kernel));
+			chosen = dynamic_divide_and_conquer(problem, [&](DynamicRow& row, size_t lo, size_t hi, int capacity)
+			{
+				stats.cells += (hi - lo) * uint64_t(capacity + 1);
+				forward(row, lo, hi, capacity);
+			});
+		}
+		else
+		{
+			DynamicOptions resolved = options;
+			resolved.strategy = strategy;
+			chosen = dynamic_select(problem, resolved);
+			stats.cells = problem.total_cost < 0 ? 0 : problem.costs.size() * uint64_t(problem.total_cost + 1);
+		}
+
+		MAXTIME_NEXT_PHASE(phase, "select");
+		result = select_rides(rides, chosen);
+	}
+	stats.bytes_allocated = counting.allocated();
+	stats.peak_bytes = counting.peak();
+	return result;
+}
+
+
+// Times of problem in centiminutes, for fixed_point_dynamic_select.
+std::pmr::vector<int32_t> fixed_point_times(const DynamicProblem& problem)
+{
+	std::pmr::vector<int32_t> times(problem.resource);
+	times.reserve(problem.times.size());
+	for (double time : problem.times)
+	{
+		times.push_back(centiminutes(time));
+	}
+	return times;
+}
+
+
+// The dynamic algorithm of fixed_point_dynamic_max_time on a prepared problem, with the
+// times of its rides in centiminutes. The full table strategy keeps an int32_t table, any
+// other a rolling int32_t row and the decision bits. Problems whose times together might
+// overflow an int32_t cell, and those the options send to the divide and conquer strategy,
+// go to dynamic_select instead.
+RideIndexList fixed_point_dynamic_select
+(
+	const DynamicProblem& problem,
+	const std::pmr::vector<int32_t>& times,
+	const DynamicOptions& options
+)
+{
+	int64_t most = 0;
+	for (int32_t time : times)
+	{
+		most += std::max(time, 0);
+	}
+	DynamicStrategy strategy = dynamic_strategy(problem, options);
+	if (most > INT32_MAX || strategy == DynamicStrategy::divide_and_conquer)
+	{
+		return dynamic_select(problem, options);
+	}
+
+	RideIndexList chosen(problem.resource);
+	int total_cost = problem.total_cost;
+	if (total_cost < 0)
+	{
+		return chosen;
+	}
+
+	size_t n = problem.costs.size();
+	FixedPointRowKernel kernel = fixed_point_row_kernel(options.kernel);
+	if (strategy == DynamicStrategy::full_table)
+	{
+		BasicDpTable<int32_t> cache(n + 1, total_cost + 2, problem.resource);
+		for (size_t i = 1; i <= n; i++)
+		{
+			kernel(cache[i - 1], cache[i], nullptr, 1, total_cost, problem.costs[i - 1], times[i - 1]);
+		}
+
+		// Integer cells, so the equality test is exact
+		int remaining = total_cost;
+		for (size_t i = n; i > 0; i--)
+		{
+			if (cache[i][remaining] != cache[i - 1][remaining])
+			{
+				chosen.push_back(i - 1);
+				remaining -= problem.costs[i - 1];
+			}
+		}
+		return chosen;
+	}
+
+	std::pmr::vector<int32_t> best(total_cost + 1, 0, problem.resource);
+	DecisionBitset taken(n, total_cost + 1, problem.resource);
+	for (size_t i = 0; i < n; i++)
+	{
+		kernel(best.data(), best.data(), taken.row(i), 0, total_cost, problem.costs[i], times[i]);
+	}
+	return dynamic_traceback(problem, taken);
+}
+
+
+// dynamic_max_time with the times of the rides rounded to centiminutes, hundredths of a
+// minute, and the DP run on int32_t cells: each vector step covers twice the columns, the
+// full table takes half the memory, and the sums the ride choices are made on are exact.
+// The plan is optimal for the rounded times, so where plans differ in time by less than
+// the rounding it may differ from the plan of dynamic_max_time.
+std::unique_ptr<RideVector> fixed_point_dynamic_max_time
+(
+	const RideVector& rides,
+	int total_cost,
+	const DynamicOptions& options = DynamicOptions()
+)
+{
+	DynamicProblem problem = dynamic_problem(rides, total_cost);
+	return select_rides(rides, fixed_point_dynamic_select(problem, fixed_point_times(problem), options));
+}
+
+
+// fixed_point_dynamic_max_time over the given rows of table, reading its centiminute column;
+// returns the chosen rows.
+RideIndexList fixed_point_dynamic_max_time
+(
+	const RideTable& table,
+	const RideIndexList& rows,
+	int total_cost,
+	const DynamicOptions& options = DynamicOptions()
+)
+{
+	DynamicProblem problem = dynamic_problem(table, rows, total_cost);
+	std::pmr::vector<int32_t> times(problem.resource);
+	times.reserve(rows.size());
+	for (size_t row : rows)
+	{
+		times.push_back(table.centiminutes(row));
+	}
+	return table_rows(rows, fixed_point_dynamic_select(problem, times, options));
+}
+
+
+// The dynamic algorithm for a budget fixed at compile time, over the unreduced costs.
+// The row is a std::array on the stack, updated in place from the top down as by the rolling
+// row strategy through the fastest KnapsackRowKernel, and the decision bits of each ride are
+// a std::array too, so there is one allocation in all. Only the row width is fixed: the trip
+// count of each row still depends on the ride's cost, so what the specialization saves is
+// the setup of dynamic_max_time, which matters most for small budgets.
+// The decisions are those of dynamic_max_time, since dividing by the cost divisor only drops
+// columns the traceback never visits.
+template <int Budget>
+RideIndexList dynamic_select_fixed(const RideVector& rides)
+{
+	static_assert(Budget >= 0, "the budget must not be negative");
+	constexpr size_t words = (size_t(Budget) + 1 + 63) / 64;
+
+	size_t n = rides.size();
+	std::array<double, Budget + 1> best = {};
+	std::vector<std::array<uint64_t, words>> taken(n);
+	KnapsackRowKernel kernel = knapsack_row_kernel(KnapsackKernel::automatic);
+	for (size_t i = 0; i < n; i++)
+	{
+		uint64_t* bits = taken[i].data();
+		int cost = rides[i]->cost();
+		double time = rides[i]->time();
+		kernel(best.data(), best.data(), bits, 0, Budget, cost, time);
+	}
+
+	RideIndexList chosen;
+	int remaining = Budget;
+	for (size_t i = n; i > 0; i--)
+	{
+		if ((taken[i - 1][remaining / 64] >> (remaining % 64)) & 1)
+		{
+			chosen.push_back(i - 1);
+			remaining -= rides[i - 1]->cost();
+		}
+	}
+	return chosen;
+}
+
+
+// Budgets with a compiled dynamic_select_fixed, and the function for each, for
+// dynamic_max_time_fixed: those where it beats dynamic_max_time in maxtime_bench. By 2000
+// the setup it saves is lost in the fill, and dynamic_max_time is as fast or faster.
+typedef RideIndexList (*FixedDynamicSelect)(const RideVector& rides);
+const std::pair<int, FixedDynamicSelect> fixed_dynamic_budgets[] =
+{
+	{ 100, dynamic_select_fixed<100> },
+	{ 250, dynamic_select_fixed<250> },
+	{ 500, dynamic_select_fixed<500> },
+	{ 1000, dynamic_select_fixed<1000> },
+};
+
+
+// dynamic_max_time(rides, total_cost), through dynamic_select_fixed when total_cost is one
+// of fixed_dynamic_budgets, and the general algorithm otherwise.
+std::unique_ptr<RideVector> dynamic_max_time_fixed(const RideVector& rides, int total_cost)
+{
+	for (auto& fixed : fixed_dynamic_budgets)
+	{
+		if (fixed.first == total_cost)
+		{
+			return select_rides(rides, fixed.second(rides));
+		}
+	}
+	return dynamic_max_time(rides, total_cost);
+}
+
+
+// Called by dynamic_max_time_batch with the position of a budget in budgets, and its rides.
+typedef std::function<void(size_t budget_index, std::unique_ptr<RideVector> rides)> DynamicBatchCallback;
+
+
+// Compute dynamic_max_time(rides, budget, options) for every budget in budgets, passing each
+// result to done as soon as it is ready, in the order of budgets.
+// Column j of the table never depends on columns past j, so a single pass at the largest
+// budget decides every smaller budget too: the rows are filled once, keeping only their
+// decision bits, and each budget costs just its own traceback. When the decisions for the
+// largest budget would pass options.divide_and_conquer_cells, each budget is instead solved
+// on its own with the divide and conquer strategy.
+void dynamic_max_time_batch
+(
+	const RideVector& rides,
+	const std::vector<int>& budgets,
+	const DynamicBatchCallback& done,
+	const DynamicOptions& options = DynamicOptions()
+)
+{
+	int largest = -1;
+	for (int budget : budgets)
+	{
+		largest = std::max(largest, budget);
+	}
+
+	DynamicProblem problem = dynamic_problem(rides, largest);
+	KnapsackRowKernel kernel = knapsack_row_kernel(options.kernel);
+	std::unique_ptr<DecisionBitset> taken;
+	if (largest >= 0 && dynamic_strategy(problem, options) == DynamicStrategy::divide_and_conquer)
+	{
+		for (size_t b = 0; b < budgets.size(); b++)
+		{
+			DynamicProblem budget_problem = problem;
+			budget_problem.total_cost = budgets[b] < 0 ? -1 : budgets[b] / problem.cost_gcd;
+			done(b, select_rides(rides, dynamic_divide_and_conquer(budget_problem, dynamic_serial_forward(budget_problem, kernel))));
+		}
+		return;
+	}
+
+	if (largest >= 0)
+	{
+		size_t n = problem.costs.size();
+		std::vector<double> best(problem.total_cost + 1, 0.0);
+		taken.reset(new DecisionBitset(n, problem.total_cost + 1));
+		for (size_t i = 0; i < n; i++)
+		{
+			kernel(best.data(), best.data(), taken->row(i), 0, problem.total_cost, problem.costs[i], problem.times[i]);
+		}
+	}
+
+	for (size_t b = 0; b < budgets.size(); b++)
+	{
+		if (budgets[b] < 0)
+		{
+			done(b, std::unique_ptr<RideVector>(new RideVector));
+		}
+		else
+		{
+			done(b, select_rides(rides, dynamic_traceback(problem, *taken, budgets[b] / problem.cost_gcd)));
+		}
+	}
+}
+
+
+// dynamic_max_time_batch, collecting the results in the order of budgets.
+std::vector<std::unique_ptr<RideVector>> dynamic_max_time_batch
+(
+	const RideVector& rides,
+	const std::vector<int>& budgets,
+	const DynamicOptions& options = DynamicOptions()
+)
+{
+	std::vector<std::unique_ptr<RideVector>> results(budgets.size());
+	dynamic_max_time_batch(
+		rides,
+		budgets,
+		[&](size_t budget_index, std::unique_ptr<RideVector> chosen) { results[budget_index] = std::move(chosen); },
+		options
+	);
+	return results;
+}
+
+
+// The dynamic algorithm kept up to date across edits of its list of rides.
+// The solver holds the decision bits of every ride for budgets up to max_budget, the last row
+// of the table, and a copy of that row every checkpoint_interval rides. Appending a ride
+// computes its one row; removing the ride at some position only invalidates the rows from
+// the checkpoint before it, which are recomputed by the next solve(). solve() is then a
+// traceback, and takes the same rides as dynamic_max_time on rides().
+class IncrementalDynamicSolver
+{
+	//
+	public:
+
+		//
+		IncrementalDynamicSolver
+		(
+			int max_budget,
+			size_t checkpoint_interval = 64,
+			KnapsackKernel kernel = KnapsackKernel::automatic
+		)
+			:
+			_max_budget(std::max(max_budget, 0)),
+			_interval(std::max<size_t>(checkpoint_interval, 1)),
+			_words_per_row((size_t(_max_budget) + 1 + 63) / 64),
+			_kernel(knapsack_row_kernel(kernel)),
+			_row(size_t(_max_budget) + 1, 0.0),
+			_checkpoints(1, _row),
+			_valid(0),
+			_rows_computed(0)
+		{}
+
+		//
+		int max_budget() const { return _max_budget; }
+		size_t size() const { return _rides.size(); }
+		const RideVector& rides() const { return _rides; }
+
+		// Rows of the table computed so far, for measuring the cost of edits.
+		size_t rows_computed() const { return _rows_computed; }
+
+		// Add a ride after the others; one row update, unless earlier edits are still pending.
+		void append(const std::shared_ptr<RideItem>& ride)
+		{
+			_rides.push_back(ride);
+			if (_valid + 1 == _rides.size() && row_is_current())
+			{
+				advance();
+			}
+		}
+
+		// Remove the ride at position index.
+		void remove(size_t index)
+		{
+			assert(index < _rides.size());
+			_rides.erase(_rides.begin() + index);
+			_valid = std::min(_valid, index);
+		}
+
+		// dynamic_max_time(rides(), budget); budgets past max_budget are solved from scratch.
+		std::unique_ptr<RideVector> solve(int budget)
+		{
+			if (budget < 0)
+			{
+				return std::unique_ptr<RideVector>(new RideVector);
+			}
+			if (budget > _max_budget)
+			{
+				return dynamic_max_time(_rides, budget);
+			}
+
+			refresh();
+			std::unique_ptr<RideVector> result(new RideVector);
+			int remaining = budget;
+			for (size_t i = _rides.size(); i > 0; i--)
+			{
+				const uint64_t* taken = _decisions.data() + (i - 1) * _words_per_row;
+				if ((taken[remaining / 64] >> (remaining % 64)) & 1)
+				{
+					result->push_back(_rides[i - 1]);
+					remaining -= _rides[i - 1]->cost();
+				}
+			}
+			return result;
+		}
+
+	//
+	private:
+
+		// Compute the row of ride _valid from the current row.
+		void advance()
+		{
+			const RideItem& ride = *_rides[_valid];
+			_decisions.resize((_valid + 1) * _words_per_row);
+			uint64_t* taken = _decisions.data() + _valid * _words_per_row;
+			std::fill(taken, taken + _words_per_row, 0);
+			_kernel(_row.data(), _row.data(), taken, 0, _max_budget, ride.cost(), ride.time());
+			_valid++;
+			_rows_computed++;
+			if (_valid % _interval == 0 && _checkpoints.size() == _valid / _interval)
+			{
+				_checkpoints.push_back(_row);
+			}
+		}
+
+		// Whether _row is the row after the first _valid rides, i.e. no rows were invalidated.
+		bool row_is_current() const { return _decisions.size() == _valid * _words_per_row; }
+
+		// Recompute the rows invalidated by removals, from the last checkpoint still valid.
+		void refresh()
+		{
+			if (_valid == _rides.size() && row_is_current())
+			{
+				return;
+			}
+			size_t checkpoint = _valid / _interval;
+			_checkpoints.resize(checkpoint + 1);
+			_row = _checkpoints[checkpoint];
+			_valid = checkpoint * _interval;
+			while (_valid < _rides.size())
+			{
+				advance();
+			}
+			_decisions.resize(_valid * _words_per_row);
+		}
+
+		//
+		int _max_budget;
+		size_t _interval, _words_per_row;
+		KnapsackRowKernel _kernel;
+		RideVector _rides;
+
+		// Decision bits of every ride, row after row, and the row after the first _valid rides
+		std::vector<uint64_t> _decisions;
+		std::vector<double> _row;
+
+		// Entry c is the row after the first c * _interval rides
+		std::vector<std::vector<double>> _checkpoints;
+
+		// Number of leading rides whose rows are up to date
+		size_t _valid;
+		size_t _rows_computed;
+};
+
+
+// Compute the optimal plan when ride i may be taken up to max_counts[i] times, within
+// total_cost. Each count is split into parts of 1, 2, 4, ... rides and a remainder, every
+// count up to the maximum being a sum of distinct parts, and each part becomes one item of the
+// 0/1 dynamic algorithm; the table then has O(sum of log(count)) rows rather than one per
+// ticket. Counts past what the budget could ever pay for are cut first.
+// Rides are returned with repeats, a part at a time, last-considered part first; with every
+// count at most 1 the result is the one of dynamic_max_time.
+std::unique_ptr<RideVector> bounded_dynamic_max_time
+(
+	const RideVector& rides,
+	const std::vector<int>& max_counts,
+	int total_cost,
+	const DynamicOptions& options = DynamicOptions()
+)
+{
+	assert(max_counts.size() == rides.size());
+
+	// For each part, the ride and how many times it is taken
+	std::vector<std::pair<size_t, int>> parts;
+	for (size_t i = 0; i < rides.size(); i++)
+	{
+		int count = total_cost < 0 ? 0 : std::min(max_counts[i], total_cost / rides[i]->cost());
+		for (int part = 1; count > 0; part *= 2)
+		{
+			int taken = std::min(part, count);
+			parts.emplace_back(i, taken);
+			count -= taken;
+		}
+	}
+
+	DynamicProblem problem;
+	int divisor = 0;
+	for (auto& part : parts)
+	{
+		divisor = std::gcd(divisor, rides[part.first]->cost() * part.second);
+	}
+	problem.cost_gcd = divisor > 0 ? divisor : 1;
+	problem.total_cost = total_cost < 0 ? -1 : total_cost / problem.cost_gcd;
+	problem.costs.reserve(parts.size());
+	problem.times.reserve(parts.size());
+	for (auto& part : parts)
+	{
+		problem.costs.push_back(rides[part.first]->cost() * part.second / problem.cost_gcd);
+		problem.times.push_back(rides[part.first]->time() * part.second);
+	}
+
+	std::unique_ptr<RideVector> result(new RideVector);
+	for (size_t p : dynamic_select(problem, options))
+	{
+		result->insert(result->end(), parts[p].second, rides[parts[p].first]);
+	}
+	return result;
+}
+
+
+// Reductions applied by preprocess_rides.
+struct PreprocessOptions
+{
+	// Also leave out rides that are dominated: other rides cost no more and last at least as
+	// long, enough of them that no plan within the budget can hold the ride and all of them.
+	// The best total time is unchanged, but among plans with that time a different one may
+	// be chosen, so this is off by default.
+	bool prune_dominated = false;
+};
+
+
+// What preprocess_rides left out.
+struct PreprocessStats
+{
+	size_t no_time = 0;
+	size_t over_budget = 0;
+	size_t dominated = 0;
+};
+
+
+// Positions, in ride order, of the rides worth giving the dynamic algorithm for total_cost.
+// Rides without positive time, and rides costing more than the budget, are never taken: their
+// rows of the table equal the rows before them, so leaving them out changes no decision and
+// the same rides are chosen. (Dividing by the greatest common divisor of the costs is already
+// done by dynamic_problem.)
+// With options.prune_dominated, a ride d is also left out when the rides kept so far that
+// dominate it cost more than total_cost - cost(d) together: any plan holding d then misses one
+// of them, and trading d for it loses nothing. Dominators of d are the rides that cost at most
+// as much and last at least as long, ties going to the earlier ride, so rides are visited
+// cheapest first, longest first within a cost. Each cost is a bucket of kept times in
+// descending order, and the dominators in a bucket are counted with a binary search.
+RideIndexList preprocess_rides
+(
+	const RideVector& rides,
+	int total_cost,
+	const PreprocessOptions& options,
+	PreprocessStats& stats
+)
+{
+	stats = PreprocessStats();
+	RideIndexList kept;
+	for (size_t i = 0; i < rides.size(); i++)
+	{
+		if (!(rides[i]->time() > 0))
+		{
+			stats.no_time++;
+		}
+		else if (rides[i]->cost() > total_cost)
+		{
+			stats.over_budget++;
+		}
+		else
+		{
+			kept.push_back(i);
+		}
+	}
+	if (!options.prune_dominated)
+	{
+		return kept;
+	}
+
+	RideIndexList order(kept);
+	std::sort(order.begin(), order.end(), [&](size_t a, size_t b)
+	{
+		if (rides[a]->cost() != rides[b]->cost())
+		{
+			return rides[a]->cost() < rides[b]->cost();
+		}
+		if (rides[a]->time() != rides[b]->time())
+		{
+			return rides[a]->time() > rides[b]->time();
+		}
+		return a < b;
+	});
+
+	// Kept times for each cost, longest first
+	std::vector<std::pair<int, std::vector<double>>> buckets;
+	std::vector<char> keep(rides.size(), 0);
+	for (size_t d : order)
+	{
+		int cost = rides[d]->cost();
+		double time = rides[d]->time();
+		if (buckets.empty() || buckets.back().first != cost)
+		{
+			buckets.emplace_back(cost, std::vector<double>());
+		}
+
+		int64_t room = int64_t(total_cost) - cost, dominating = 0;
+		for (auto& bucket : buckets)
+		{
+			const std::vector<double>& times = bucket.second;
+			size_t count = std::upper_bound(times.begin(), times.end(), time, std::greater<double>()) - times.begin();
+			dominating += int64_t(bucket.first) * int64_t(count);
+			if (dominating > room)
+			{
+				break;
+			}
+		}
+
+		if (dominating > room)
+		{
+			stats.dominated++;
+		}
+		else
+		{
+			buckets.back().second.push_back(time);
+			keep[d] = 1;
+		}
+	}
+
+	RideIndexList result;
+	for (size_t i : kept)
+	{
+		if (keep[i])
+		{
+			result.push_back(i);
+		}
+	}
+	return result;
+}
+
+
+// dynamic_max_time on the rides left by preprocess_rides. Without options.prune_dominated the
+// same rides are returned, in the same order, from a table with fewer rows.
+std::unique_ptr<RideVector> preprocessed_dynamic_max_time
+(
+	const RideVector& rides,
+	int total_cost,
+	const PreprocessOptions& options,
+	PreprocessStats& stats,
+	const DynamicOptions& dynamic_options = DynamicOptions()
+)
+{
+	RideIndexList kept = preprocess_rides(rides, total_cost, options, stats);
+	DynamicProblem problem = dynamic_problem(rides, kept, total_cost);
+	return select_rides(rides, table_rows(kept, dynamic_select(problem, dynamic_options)));
+}
+
+
+// preprocessed_dynamic_max_time, without the statistics.
+std::unique_ptr<RideVector> preprocessed_dynamic_max_time
+(
+	const RideVector& rides,
+	int total_cost,
+	const PreprocessOptions& options = PreprocessOptions()
+)
+{
+	PreprocessStats stats;
+	return preprocessed_dynamic_max_time(rides, total_cost, options, stats);
+}
+
+
+// Rows [lo, hi) of the dynamic algorithm over columns [0, capacity] of row, on every thread
+// of pool. Each thread owns a slice of the columns, aligned to 64 so that slices never share
+// a word of taken, and a barrier separates consecutive rows. Rows are double-buffered since
+// a slice reads cells of the previous row owned by other slices.
+// When taken is non-null, the decisions for ride i go to row i of it.
+void parallel_dynamic_rows
+(
+	ThreadPool& pool,
+	const DynamicProblem& problem,
+	size_t lo,
+	size_t hi,
+	int capacity,
+	DynamicRow& row,
+	DecisionBitset* taken,
+	KnapsackRowKernel kernel
+)
+{
+	DynamicRow scratch(row.size(), 0.0, row.get_allocator());
+	double* buffers[2] = { row.data(), scratch.data() };
+	size_t blocks = (size_t(capacity) + 1 + 63) / 64;
+	size_t team = pool.size();
+	Barrier barrier(team);
+
+	pool.run_team([&](size_t index)
+	{
+		int first = int(blocks * index / team * 64);
+		int last = std::min(int(blocks * (index + 1) / team * 64), capacity + 1) - 1;
+		for (size_t i = lo; i < hi; i++)
+		{
+			if (first <= last)
+			{
+				kernel(
+					buffers[(i - lo) % 2],
+					buffers[(i - lo + 1) % 2],
+					taken ? taken->row(i) : nullptr,
+					first,
+					last,
+					problem.costs[i],
+					problem.times[i]
+				);
+			}
+			barrier.wait();
+		}
+	});
+
+	if ((hi - lo) % 2 == 1)
+	{
+		std::copy(scratch.begin(), scratch.begin() + capacity + 1, row.begin());
+	}
+}
+
+
+// The parallel dynamic algorithm on a prepared problem; see parallel_dynamic_max_time.
+RideIndexList parallel_dynamic_select
+(
+	const DynamicProblem& problem,
+	ThreadPool& pool,
+	const DynamicOptions& options
+)
+{
+	if (problem.total_cost < 0 || problem.costs.empty())
+	{
+		return RideIndexList();
+	}
+
+	KnapsackRowKernel kernel = knapsack_row_kernel(options.kernel);
+	if (dynamic_strategy(problem, options) == DynamicStrategy::divide_and_conquer)
+	{
+		return dynamic_divide_and_conquer(
+			problem,
+			[&](DynamicRow& row, size_t lo, size_t hi, int capacity)
+			{
+				parallel_dynamic_rows(pool, problem, lo, hi, capacity, row, nullptr, kernel);
+			}
+		);
+	}
+
+	DynamicRow best(problem.total_cost + 1, 0.0, problem.resource);
+	DecisionBitset taken(problem.costs.size(), problem.total_cost + 1, problem.resource);
+	parallel_dynamic_rows(pool, problem, 0, problem.costs.size(), problem.total_cost, best, &taken, kernel);
+	return dynamic_traceback(problem, taken);
+}
+
+
+// Compute the same rides as dynamic_max_time, spreading the work of each row over the threads
+// of pool. Past options.divide_and_conquer_cells the divide and conquer strategy is used, with
+// its forward passes run in parallel; otherwise the decisions go to a shared bitset.
+std::unique_ptr<RideVector> parallel_dynamic_max_time
+(
+	const RideVector& rides,
+	int total_cost,
+	ThreadPool& pool,
+	const DynamicOptions& options = DynamicOptions()
+)
+{
+	return select_rides(rides, parallel_dynamic_select(dynamic_problem(rides, total_cost), pool, options));
+}
+
+
+// parallel_dynamic_max_time on the process-wide pool of the given number of threads.
+std::unique_ptr<RideVector> parallel_dynamic_max_time
+(
+	const RideVector& rides,
+	int total_cost,
+	size_t threads,
+	const DynamicOptions& options = DynamicOptions()
+)
+{
+	return parallel_dynamic_max_time(rides, total_cost, shared_thread_pool(threads), options);
+}
+
+
+// Tuning knobs for constrained_max_time.
+struct ConstrainedOptions
+{
+	// Width of one step of the duration axis, in minutes. Ride times are rounded up to whole
+	// steps and the time window down, so every plan found fits the window; a finer step
+	// loses less of the window to rounding, for a proportionally larger state.
+	double duration_step = 1;
+
+	// Also leave out dominated rides, as preprocess_rides does with prune_dominated; see
+	// constrained_preprocess. The best total time is unchanged, but a different plan with
+	// that time may be chosen, so this is off by default.
+	bool prune_dominated = false;
+
+	// Threads the cost axis is split over; with one, the state is updated in place.
+	size_t threads = 1;
+
+	// Problems whose decision bits would take more than this many bits keep none, and
+	// reconstruct the plan by divide and conquer instead, as DynamicStrategy::divide_and_conquer.
+	// The default caps the bits at 512 MiB.
+	size_t divide_and_conquer_cells = size_t(1) << 32;
+};
+
+
+// The problem of constrained_max_time, with costs divided by their greatest common divisor
+// and durations in whole steps.
+struct ConstrainedProblem
+{
+	// Positions of the rides left by preprocessing, and their fields
+	RideIndexList positions;
+	std::vector<int> costs, steps;
+	std::vector<double> times;
+
+	// The budget, divided by cost_gcd, and the time window, in steps
+	int total_cost;
+	int total_steps;
+	int cost_gcd;
+};
+
+
+// Whole steps of step minutes that time takes, rounded up, or down with down; rounding errors
+// below 1e-9 of a step are ignored, so e.g. 1.5 minutes is exactly 3 steps of 0.5.
+int constrained_steps(double time, double step, bool down = false)
+{
+	double steps = time / step;
+	double rounded = down ? std::floor(steps + 1e-9) : std::ceil(steps - 1e-9);
+	return int(std::min(std::max(rounded, 0.0), double(INT32_MAX)));
+}
+
+
+// Positions, in ride order, of the rides worth giving the constrained algorithm, and their
+// durations in steps. Rides without positive time, or over the budget or window on their own,
+// are left out, which changes no decision. With prune_dominated, a ride d is also left out
+// when the rides kept so far that dominate it cost more than total_cost - cost(d) together,
+// or take more than total_steps - steps(d); any plan holding d then misses one of them, and
+// trading d for it costs no more, takes no more steps and loses no time. Dominators of d cost
+// at most as much, take at most as many steps and last at least as long, ties going to the
+// earlier ride, so rides are visited in that order.
+// Steps never decrease with time, so the dominators of d take exactly as many steps as d.
+// Each step count is therefore a bucket of its own: rides are visited cheapest first, and
+// the kept rides of a bucket sit in a Fenwick tree over their order by time, summing their costs
+// and counting them, so the whole pass takes O(n log n).
+RideIndexList constrained_preprocess
+(
+	const RideVector& rides,
+	int total_cost,
+	int total_steps,
+	double step,
+	bool prune_dominated,
+	std::vector<int>& steps
+)
+{
+	steps.assign(rides.size(), 0);
+	RideIndexList kept;
+	for (size_t i = 0; i < rides.size(); i++)
+	{
+		steps[i] = constrained_steps(rides[i]->time(), step);
+		if (rides[i]->time() > 0 && rides[i]->cost() <= total_cost && steps[i] <= total_steps)
+		{
+			kept.push_back(i);
+		}
+	}
+	if (!prune_dominated)
+	{
+		return kept;
+	}
+
+	// Position of each ride by time within its bucket, longest first, and the last position
+	// holding the same time, so the prefix up to it holds every ride of the bucket at least as long
+	std::unordered_map<int, std::vector<size_t>> buckets;
+	for (size_t i : kept)
+	{
+		buckets[steps[i]].push_back(i);
+	}
+	std::vector<size_t> rank(rides.size(), 0), upto(rides.size(), 0);
+	for (auto& bucket : buckets)
+	{
+		std::vector<size_t>& members = bucket.second;
+		std::sort(members.begin(), members.end(), [&](size_t a, size_t b) { return rides[a]->time() > rides[b]->time(); });
+		for (size_t k = members.size(); k-- > 0;)
+		{
+			rank[members[k]] = k;
+			bool tied = k + 1 < members.size() && rides[members[k]]->time() == rides[members[k + 1]]->time();
+			upto[members[k]] = tied ? upto[members[k + 1]] : k;
+		}
+	}
+
+	// Fenwick trees over those positions of the kept rides of each bucket: total cost, and count
+	std::unordered_map<int, std::vector<std::pair<int64_t, int64_t>>> trees;
+	for (auto& bucket : buckets)
+	{
+		trees[bucket.first].assign(bucket.second.size() + 1, { 0, 0 });
+	}
+
+	RideIndexList order(kept);
+	std::sort(order.begin(), order.end(), [&](size_t a, size_t b)
+	{
+		if (rides[a]->cost() != rides[b]->cost())
+		{
+			return rides[a]->cost() < rides[b]->cost();
+		}
+		if (rides[a]->time() != rides[b]->time())
+		{
+			return rides[a]->time() > rides[b]->time();
+		}
+		return a < b;
+	});
+
+	std::vector<char> keep(rides.size(), 0);
+	for (size_t d : order)
+	{
+		std::vector<std::pair<int64_t, int64_t>>& tree = trees[steps[d]];
+		int64_t cost = 0, count = 0;
+		for (size_t k = upto[d] + 1; k > 0; k -= k & (~k + 1))
+		{
+			cost += tree[k].first;
+			count += tree[k].second;
+		}
+
+		if (cost <= int64_t(total_cost) - rides[d]->cost() && count * steps[d] <= int64_t(total_steps) - steps[d])
+		{
+			keep[d] = 1;
+			for (size_t k = rank[d] + 1; k < tree.size(); k += k & (~k + 1))
+			{
+				tree[k].first += rides[d]->cost();
+				tree[k].second++;
+			}
+		}
+	}
+
+	RideIndexList result;
+	for (size_t i : kept)
+	{
+		if (keep[i])
+		{
+			result.push_back(i);
+		}
+	}
+	return result;
+}
+
+
+// The ConstrainedProblem for rides, budget total_cost and a time window of time_window minutes.
+ConstrainedProblem constrained_problem
+(
+	const RideVector& rides,
+	int total_cost,
+	double time_window,
+	const ConstrainedOptions& options
+)
+{
+	assert(options.duration_step > 0);
+	ConstrainedProblem problem;
+	problem.total_steps = time_window < 0 ? -1 : constrained_steps(time_window, options.duration_step, true);
+	std::vector<int> steps;
+	problem.positions = constrained_preprocess(rides, total_cost, problem.total_steps, options.duration_step, options.prune_dominated, steps);
+
+	int divisor = 0;
+	for (size_t i : problem.positions)
+	{
+		divisor = std::gcd(divisor, rides[i]->cost());
+	}
+	problem.cost_gcd = divisor > 0 ? divisor : 1;
+	problem.total_cost = total_cost < 0 || time_window < 0 ? -1 : total_cost / problem.cost_gcd;
+	for (size_t i : problem.positions)
+	{
+		problem.costs.push_back(rides[i]->cost() / problem.cost_gcd);
+		problem.steps.push_back(steps[i]);
+		problem.times.push_back(rides[i]->time());
+	}
+	return problem;
+}
+
+
+// Bits per cost row of the decision bits of the constrained algorithm: a duration row,
+// padded to whole words so that cost rows never share a word.
+size_t constrained_bit_stride(int total_steps)
+{
+	return (size_t(total_steps) + 1 + 63) / 64 * 64;
+}
+
+
+// One ride of the constrained algorithm over cost rows [first, last] and duration columns
+// [0, capacity] of the state, whose cell (c, d) holds the longest plan of cost at most c
+// and at most d steps:
+//	next[c][d] = max(time + previous[c - cost][d - steps], previous[c][d])
+// with bit c * bit_stride + d of taken set where the first term is strictly greater. Each
+// duration row is a contiguous loop reading two other rows. previous and next may be the same
+// state, since rows are visited from the top down and only read lower rows.
+void constrained_rows
+(
+	const ConstrainedProblem& problem,
+	size_t ride,
+	const DpTable& previous,
+	DpTable& next,
+	uint64_t* taken,
+	size_t bit_stride,
+	int first,
+	int last,
+	int capacity
+)
+{
+	int cost = problem.costs[ride], steps = problem.steps[ride];
+	double time = problem.times[ride];
+	for (int c = last; c >= first; c--)
+	{
+		const double* without = previous[c];
+		double* row = next[c];
+		int low = c >= cost ? std::min(steps, capacity + 1) : capacity + 1;
+		if (row != without)
+		{
+			std::copy(without, without + low, row);
+		}
+		if (low > capacity)
+		{
+			continue;
+		}
+
+		const double* with = previous[c - cost];
+		uint64_t* bits = taken ? taken + c * bit_stride / 64 : nullptr;
+		for (int d = low; d <= capacity; d++)
+		{
+			double candidate = time + with[d - steps];
+			bool take = candidate > without[d];
+			row[d] = take ? candidate : without[d];
+			if (bits)
+			{
+				bits[d / 64] |= uint64_t(take) << (d % 64);
+			}
+		}
+	}
+}
+
+
+// Advances state, holding cost rows [0, cost_capacity] and duration columns
+// [0, step_capacity] after the rides before lo, past the rides [lo, hi).
+typedef std::function<void(DpTable& state, size_t lo, size_t hi, int cost_capacity, int step_capacity, DecisionBitset* taken)> ConstrainedForwardPass;
+
+
+// The forward pass of the constrained algorithm on one thread, in place.
+ConstrainedForwardPass constrained_serial_forward(const ConstrainedProblem& problem)
+{
+	return [&problem](DpTable& state, size_t lo, size_t hi, int cost_capacity, int step_capacity, DecisionBitset* taken)
+	{
+		size_t bit_stride = constrained_bit_stride(problem.total_steps);
+		for (size_t i = lo; i < hi; i++)
+		{
+			constrained_rows(problem, i, state, state, taken ? taken->row(i) : nullptr, bit_stride, 0, cost_capacity, step_capacity);
+		}
+	};
+}
+
+
+// The forward pass of the constrained algorithm on every thread of pool. Each thread owns a
+// contiguous slice of the cost rows, and a barrier separates consecutive rides; the state is
+// double-buffered, since a slice reads rows of the previous state owned by other slices.
+// The second buffer is allocated once, at full size, and reused by every call, e.g. by all
+// those of the divide and conquer reconstruction.
+ConstrainedForwardPass constrained_parallel_forward(const ConstrainedProblem& problem, ThreadPool& pool)
+{
+	auto buffer = std::make_shared<DpTable>(problem.total_cost + 1, problem.total_steps + 1);
+	return [&problem, &pool, buffer](DpTable& state, size_t lo, size_t hi, int cost_capacity, int step_capacity, DecisionBitset* taken)
+	{
+		size_t bit_stride = constrained_bit_stride(problem.total_steps);
+		DpTable& scratch = *buffer;
+		DpTable* buffers[2] = { &state, &scratch };
+		size_t rows = size_t(cost_capacity) + 1;
+		size_t team = pool.size();
+		Barrier barrier(team);
+
+		pool.run_team([&](size_t index)
+		{
+			int first = int(rows * index / team);
+			int last = int(rows * (index + 1) / team) - 1;
+			for (size_t i = lo; i < hi; i++)
+			{
+				if (first <= last)
+				{
+					constrained_rows(
+						problem,
+						i,
+						*buffers[(i - lo) % 2],
+						*buffers[(i - lo + 1) % 2],
+						taken ? taken->row(i) : nullptr,
+						bit_stride,
+						first,
+						last,
+						step_capacity
+					);
+				}
+				barrier.wait();
+			}
+		});
+
+		if ((hi - lo) % 2 == 1)
+		{
+			for (size_t c = 0; c < rows; c++)
+			{
+				std::copy(scratch[c], scratch[c] + step_capacity + 1, state[c]);
+			}
+		}
+	};
+}
+
+
+// Recursive step of the divide and conquer reconstruction of constrained_max_time, as
+// dynamic_divide_and_conquer_rows with a capacity on each axis. base holds the state after
+// the rides before lo, at least up to the capacities, which are what is left when the
+// traceback reaches ride hi; returns what is left when it reaches ride lo.
+std::pair<int, int> constrained_divide_and_conquer_rows
+(
+	const ConstrainedProblem& problem,
+	size_t lo,
+	size_t hi,
+	const DpTable& base,
+	int cost_capacity,
+	int step_capacity,
+	const ConstrainedForwardPass& forward,
+	RideIndexList& chosen
+)
+{
+	if (hi - lo == 1)
+	{
+		int cost = problem.costs[lo], steps = problem.steps[lo];
+		if (cost_capacity >= cost && step_capacity >= steps
+			&& problem.times[lo] + base[cost_capacity - cost][step_capacity - steps] > base[cost_capacity][step_capacity])
+		{
+			chosen.push_back(lo);
+			return { cost_capacity - cost, step_capacity - steps };
+		}
+		return { cost_capacity, step_capacity };
+	}
+
+	size_t mid = lo + (hi - lo) / 2;
+	std::pair<int, int> left;
+	{
+		// The state after ride mid, computed the same way as in one pass so the comparisons agree
+		DpTable state(cost_capacity + 1, step_capacity + 1);
+		for (int c = 0; c <= cost_capacity; c++)
+		{
+			std::copy(base[c], base[c] + step_capacity + 1, state[c]);
+		}
+		forward(state, lo, mid, cost_capacity, step_capacity, nullptr);
+		left = constrained_divide_and_conquer_rows(problem, mid, hi, state, cost_capacity, step_capacity, forward, chosen);
+	}
+	return constrained_divide_and_conquer_rows(problem, lo, mid, base, left.first, left.second, forward, chosen);
+}
+
+
+// The constrained algorithm on a prepared problem; returns positions within problem, last
+// ride first.
+RideIndexList constrained_select(const ConstrainedProblem& problem, const ConstrainedOptions& options)
+{
+	RideIndexList chosen;
+	size_t n = problem.costs.size();
+	if (problem.total_cost < 0 || problem.total_steps < 0 || n == 0)
+	{
+		return chosen;
+	}
+
+	ConstrainedForwardPass forward = options.threads > 1
+		? constrained_parallel_forward(problem, shared_thread_pool(options.threads))
+		: constrained_serial_forward(problem);
+	DpTable state(problem.total_cost + 1, problem.total_steps + 1);
+	size_t bit_stride = constrained_bit_stride(problem.total_steps);
+	double bits = double(n) * (double(problem.total_cost) + 1) * double(bit_stride);
+	if (bits > double(options.divide_and_conquer_cells))
+	{
+		constrained_divide_and_conquer_rows(problem, 0, n, state, problem.total_cost, problem.total_steps, forward, chosen);
+		return chosen;
+	}
+
+	DecisionBitset taken(n, (size_t(problem.total_cost) + 1) * bit_stride);
+	forward(state, 0, n, problem.total_cost, problem.total_steps, &taken);
+	int cost = problem.total_cost, steps = problem.total_steps;
+	for (size_t i = n; i > 0; i--)
+	{
+		if (taken.test(i - 1, cost * bit_stride + steps))
+		{
+			chosen.push_back(i - 1);
+			cost -= problem.costs[i - 1];
+			steps -= problem.steps[i - 1];
+		}
+	}
+	return chosen;
+}
+
+
+// Compute the longest plan that fits both a total_cost budget and a time window of
+// time_window minutes, in one pass of a dynamic algorithm over cost and duration.
+// Durations are counted in whole steps of options.duration_step, each ride rounded up, so the
+// plan fits the window for sure but may leave up to a step per ride of it unused. The state
+// is the (budget + 1) x (steps + 1) table of the longest plans after each ride, rolled from
+// ride to ride, and reconstruction uses one decision bit per cell and ride, or divide and
+// conquer past options.divide_and_conquer_cells; both give the same rides.
+// Rides are returned last-considered first; with a window no ride set can fill, the total
+// time is that of dynamic_max_time.
+std::unique_ptr<RideVector> constrained_max_time
+(
+	const RideVector& rides,
+	int total_cost,
+	double time_window,
+	const ConstrainedOptions& options = ConstrainedOptions()
+)
+{
+	ConstrainedProblem problem = constrained_problem(rides, total_cost, time_window, options);
+	return select_rides(rides, table_rows(problem.positions, constrained_select(problem, options)));
+}
+
+
+// dynamic_max_time over the rides of view, without materializing it.
+std::unique_ptr<RideVector> dynamic_max_time
+(
+	const RideFilterView& view,
+	int total_cost,
+	const DynamicOptions& options = DynamicOptions()
+)
+{
+	const RideVector& rides = view.source();
+	RideIndexList positions = view.indices();
+
+	DynamicProblem problem = dynamic_problem(rides, positions, total_cost);
+	return select_rides(rides, table_rows(positions, dynamic_select(problem, options)));
+}
+
+
+// dynamic_max_time over the given rows of table; returns the chosen rows, in the same
+// order as dynamic_max_time returns rides.
+RideIndexList dynamic_max_time
+(
+	const RideTable& table,
+	const RideIndexList& rows,
+	int total_cost,
+	const DynamicOptions& options = DynamicOptions()
+)
+{
+	return table_rows(rows, dynamic_select(dynamic_problem(table, rows, total_cost), options));
+}
+
+
+// dynamic_max_time over the given rows of table, with all working memory and the result
+// allocated from arena; the result is valid until the arena is reset.
+RideIndexList dynamic_max_time
+(
+	const RideTable& table,
+	const RideIndexList& rows,
+	int total_cost,
+	QueryArena& arena,
+	const DynamicOptions& options = DynamicOptions()
+)
+{
+	return table_rows(rows, dynamic_select(dynamic_problem(table, rows, total_cost, arena.resource()), options));
+}
+
+
+// dynamic_max_time over every row of table.
+RideIndexList dynamic_max_time
+(
+	const RideTable& table,
+	int total_cost,
+	const DynamicOptions& options = DynamicOptions()
+)
+{
+	return dynamic_max_time(table, table.rows(), total_cost, options);
+}
+
+
+std::vector<std::vector<RideItem>> getTimeSubsets(std::vector<RideItem> source)
+{
+    std::vector<std::vector<RideItem>> subset, subTemp;
+
+    std::vector<RideItem> temp;
+    subset.push_back(temp);
+
+    for(int i = 0; i < source.size(); i++)
+    {
+        subTemp = subset;
+        for(int j = 0; j < subTemp.size(); j++){subTemp[j].push_back(source[i]);}
+        for(int k = 0; k < subTemp.size(); k++){subset.push_back(subTemp[k]);}
+    }
+    return subset;
+}
+
+// Best subset found so far by the exhaustive search, as a bit mask over the rides.
+// Subsets compare by exact total time, summed in ride order like sum_ride_vector does;
+// ties go to the lower mask, i.e. to the subset a plain 0, 1, 2, ... enumeration meets first.
+struct ExhaustiveBest
+{
+	uint64_t mask = 0;
+	double time = 0;
+	bool found = false;
+};
+
+
+// Exact total time of the rides in mask, summed in ride order.
+double exhaustive_mask_time(const std::vector<double>& times, uint64_t mask)
+{
+	double total = 0;
+	for (size_t j = 0; mask != 0; j++, mask >>= 1)
+	{
+		if (mask & 1)
+		{
+			total += times[j];
+		}
+	}
+	return total;
+}
+
+
+// Index of the lowest set bit of a non-zero word.
+int lowest_set_bit(uint64_t word)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_ctzll(word);
+#else
+	int bit = 0;
+	for ( ; (word & 1) == 0; word >>= 1)
+	{
+		bit++;
+	}
+	return bit;
+#endif
+}
+
+
+// Visit every subset prefix | s, where s ranges over the subsets of the low_bits lowest rides,
+// and fold the ones within total_cost into best.
+// Subsets are visited in Gray code order, so each step adds or removes exactly one ride and the
+// running cost and time update with a single add or subtract; there is no allocation in the
+// loop. The running time drifts by rounding, so it is re-summed exactly every few thousand
+// steps, and candidates within tolerance of best are re-summed exactly before comparing.
+// When token is non-null it is checked at every re-sum; if it asks to stop, the walk returns
+// false, with best covering only the subsets visited so far.
+bool exhaustive_gray_walk
+(
+	const std::vector<int>& costs,
+	const std::vector<double>& times,
+	int low_bits,
+	uint64_t prefix,
+	double total_cost,
+	double tolerance,
+	ExhaustiveBest& best,
+	const CancellationToken* token = nullptr,
+	uint64_t* visited = nullptr
+)
+{
+	const uint64_t resync_period = 4096;
+
+	uint64_t mask = prefix;
+	int64_t cost = 0;
+	for (uint64_t rest = prefix; rest != 0; rest &= rest - 1)
+	{
+		cost += costs[lowest_set_bit(rest)];
+	}
+	double time = exhaustive_mask_time(times, mask);
+
+	uint64_t count = uint64_t(1) << low_bits;
+	for (uint64_t step = 0; ; )
+	{
+		if (cost <= total_cost)
+		{
+			if (!best.found || time > best.time + tolerance)
+			{
+				best.mask = mask;
+				best.time = exhaustive_mask_time(times, mask);
+				best.found = true;
+			}
+			else if (time >= best.time - tolerance)
+			{
+				double exact = exhaustive_mask_time(times, mask);
+				if (exact > best.time || (exact == best.time && mask < best.mask))
+				{
+					best.mask = mask;
+					best.time = exact;
+				}
+			}
+		}
+
+		if (++step == count)
+		{
+			break;
+		}
+
+		int bit = lowest_set_bit(step);
+		uint64_t flip = uint64_t(1) << bit;
+		mask ^= flip;
+		if (mask & flip)
+		{
+			cost += costs[bit];
+			time += times[bit];
+		}
+		else
+		{
+			cost -= costs[bit];
+			time -= times[bit];
+		}
+
+		if (step % resync_period == 0)
+		{
+			time = exhaustive_mask_time(times, mask);
+			if (token && token->is_cancelled())
+			{
+				if (visited)
+				{
+					*visited = step;
+				}
+				return false;
+			}
+		}
+	}
+	if (visited)
+	{
+		*visited = count;
+	}
+	return true;
+}
+
+
+// Copy the cost and time of the first n rides into flat arrays for the exhaustive searches,
+// and return the tolerance for their near-tie checks.
+double exhaustive_fields
+(
+	const RideVector& rides,
+	int n,
+	std::vector<int>& costs,
+	std::vector<double>& times
+)
+{
+	costs.resize(n);
+	times.resize(n);
+	double magnitude = 1;
+	for (int j = 0; j < n; j++)
+	{
+		costs[j] = rides[j]->cost();
+		times[j] = rides[j]->time();
+		magnitude += std::fabs(times[j]);
+	}
+	return magnitude * 1e-12;
+}
+
+
+// The rides in mask, in ride order.
+std::unique_ptr<RideVector> exhaustive_result(const RideVector& rides, const ExhaustiveBest& best)
+{
+	std::unique_ptr<RideVector> result(new RideVector);
+	if (best.found)
+	{
+		for (uint64_t rest = best.mask; rest != 0; rest &= rest - 1)
+		{
+			result->push_back(rides[lowest_set_bit(rest)]);
+		}
+	}
+	return result;
+}
+
+
+// The positions of the rides exhaustive_max_time chooses, in ride order; see below.
+// When visited is non-null, it is set to the number of subsets visited.
+RideIndexList exhaustive_select(const RideVector& rides, double total_cost, uint64_t* visited = nullptr)
+{
+	MAXTIME_PHASE(phase, "prepare");
+	int n = std::min<int>(rides.size(), 63);
+	std::vector<int> costs;
+	std::vector<double> times;
+	double tolerance = exhaustive_fields(rides, n, costs, times);
+
+	MAXTIME_NEXT_PHASE(phase, "search");
+	ExhaustiveBest best;
+	exhaustive_gray_walk(costs, times, n, 0, total_cost, tolerance, best, nullptr, visited);
+	MAXTIME_NEXT_PHASE(phase, "decode");
+	RideIndexList chosen;
+	if (best.found)
+	{
+		for (uint64_t rest = best.mask; rest != 0; rest &= rest - 1)
+		{
+			chosen.push_back(lowest_set_bit(rest));
+		}
+	}
+	return chosen;
+}
+
+
+// Compute the optimal set of ride items with a exhaustive search algorithm.
+// Specifically, among all subsets of ride items,
+// return the subset whose dollars cost fits within the total_cost budget,
+// and whose total time is greatest.
+// To avoid overflow, only the first 63 ride items are considered.
+// Among subsets with the same total time, the one found first by counting masks upward wins.
+std::unique_ptr<RideVector> exhaustive_max_time
+(
+	const RideVector& rides,
+	double total_cost
+)
+{
+	return select_rides(rides, exhaustive_select(rides, total_cost));
+}
+
+
+// exhaustive_max_time, reporting into stats; masks counts the subsets visited.
+std::unique_ptr<RideVector> exhaustive_max_time
+(
+	const RideVector& rides,
+	double total_cost,
+	QueryStats& stats
+)
+{
+	stats = QueryStats();
+	stats.engine = "exhaustive";
+	std::unique_ptr<RideVector> result;
+	{
+		QueryStatsScope scope(stats);
+		RideIndexList chosen = exhaustive_select(rides, total_cost, &stats.masks);
+		MAXTIME_PHASE(phase, "select");
+		result = select_rides(rides, chosen);
+	}
+	return result;
+}
+
+
+// exhaustive_max_time over the given rows of table, considering the first 63 of them;
+// returns the chosen rows, in the order they appear in rows.
+RideIndexList exhaustive_max_time
+(
+	const RideTable& table,
+	const RideIndexList& rows,
+	double total_cost
+)
+{
+	int n = std::min<int>(rows.size(), 63);
+	std::vector<int> costs(n);
+	std::vector<double> times(n);
+	double magnitude = 1;
+	for (int j = 0; j < n; j++)
+	{
+		costs[j] = table.cost(rows[j]);
+		times[j] = table.time(rows[j]);
+		magnitude += std::fabs(times[j]);
+	}
+
+	ExhaustiveBest best;
+	exhaustive_gray_walk(costs, times, n, 0, total_cost, magnitude * 1e-12, best);
+	RideIndexList chosen;
+	if (best.found)
+	{
+		for (uint64_t rest = best.mask; rest != 0; rest &= rest - 1)
+		{
+			chosen.push_back(rows[lowest_set_bit(rest)]);
+		}
+	}
+	return chosen;
+}
+
+
+// exhaustive_max_time over the rides of view, without materializing it; only the first 63
+// rides of the view are evaluated.
+std::unique_ptr<RideVector> exhaustive_max_time
+(
+	const RideFilterView& view,
+	double total_cost
+)
+{
+	const RideVector& rides = view.source();
+	RideIndexList positions = view.indices(63);
+	int n = int(positions.size());
+	std::vector<int> costs(n);
+	std::vector<double> times(n);
+	double magnitude = 1;
+	for (int j = 0; j < n; j++)
+	{
+		costs[j] = rides[positions[j]]->cost();
+		times[j] = rides[positions[j]]->time();
+		magnitude += std::fabs(times[j]);
+	}
+
+	ExhaustiveBest best;
+	exhaustive_gray_walk(costs, times, n, 0, total_cost, magnitude * 1e-12, best);
+	std::unique_ptr<RideVector> result(new RideVector);
+	if (best.found)
+	{
+		for (uint64_t rest = best.mask; rest != 0; rest &= rest - 1)
+		{
+			result->push_back(rides[positions[lowest_set_bit(rest)]]);
+		}
+	}
+	return result;
+}
+
+
+// exhaustive_max_time over every row of table.
+RideIndexList exhaustive_max_time(const RideTable& table, double total_cost)
+{
+	return exhaustive_max_time(table, table.rows(), total_cost);
+}
+
+
+// Fold other into best, with the same ordering as the exhaustive search.
+void exhaustive_merge(ExhaustiveBest& best, const ExhaustiveBest& other)
+{
+	if (other.found
+		&& (!best.found
+			|| other.time > best.time
+			|| (other.time == best.time && other.mask < best.mask)))
+	{
+		best = other;
+	}
+}
+
+
+// Compute the same subset as exhaustive_max_time, spreading the subsets over the threads of
+// pool. The subsets are split by the values of their highest bits into a few chunks per
+// thread, which the threads claim one at a time; each thread keeps its own best, and
+// the per-thread bests are merged with the same tie-break as the serial search.
+std::unique_ptr<RideVector> parallel_exhaustive_max_time
+(
+	const RideVector& rides,
+	double total_cost,
+	ThreadPool& pool
+)
+{
+	int n = std::min<int>(rides.size(), 63);
+	std::vector<int> costs;
+	std::vector<double> times;
+	double tolerance = exhaustive_fields(rides, n, costs, times);
+
+	int prefix_bits = 0;
+	while (prefix_bits < n && (uint64_t(1) << prefix_bits) < 8 * pool.size())
+	{
+		prefix_bits++;
+	}
+	int low_bits = n - prefix_bits;
+	uint64_t chunks = uint64_t(1) << prefix_bits;
+
+	std::vector<ExhaustiveBest> bests(pool.size());
+	std::atomic<uint64_t> next(0);
+	pool.run_team([&](size_t index)
+	{
+		for (uint64_t chunk; (chunk = next.fetch_add(1)) < chunks; )
+		{
+			exhaustive_gray_walk(costs, times, low_bits, chunk << low_bits, total_cost, tolerance, bests[index]);
+		}
+	});
+
+	ExhaustiveBest best;
+	for (const ExhaustiveBest& other : bests)
+	{
+		exhaustive_merge(best, other);
+	}
+	return exhaustive_result(rides, best);
+}
+
+
+// parallel_exhaustive_max_time on the process-wide pool of the given number of threads.
+std::unique_ptr<RideVector> parallel_exhaustive_max_time
+(
+	const RideVector& rides,
+	double total_cost,
+	size_t threads
+)
+{
+	return parallel_exhaustive_max_time(rides, total_cost, shared_thread_pool(threads));
+}
+
+
+// One subset of half of the rides, for meet_in_middle_max_time.
+struct HalfSubset
+{
+	int64_t cost;
+	double time;
+	uint64_t mask;
+};
+
+
+// Pareto frontier of the subsets of rides [begin, end) that fit within total_cost: sorted by
+// cost, with both cost and time strictly increasing, so every entry has the greatest time
+// of any subset costing at most as much.
+// Built one ride at a time by merging the frontier with a copy of itself that includes
+// the ride, which drops dominated subsets as early as possible.
+std::vector<HalfSubset> meet_in_middle_frontier
+(
+	const std::vector<int>& costs,
+	const std::vector<double>& times,
+	int begin,
+	int end,
+	double total_cost
+)
+{
+	std::vector<HalfSubset> frontier(1, HalfSubset{0, 0, 0}), with, merged;
+	for (int j = begin; j < end; j++)
+	{
+		with.clear();
+		for (const HalfSubset& subset : frontier)
+		{
+			if (subset.cost + costs[j] <= total_cost)
+			{
+				with.push_back(HalfSubset{subset.cost + costs[j], subset.time + times[j], subset.mask | (uint64_t(1) << j)});
+			}
+		}
+
+		merged.clear();
+		auto cheaper = [](const HalfSubset& a, const HalfSubset& b)
+		{
+			return a.cost < b.cost || (a.cost == b.cost && a.time > b.time);
+		};
+		auto keep = [&](const HalfSubset& subset)
+		{
+			if (merged.empty() || subset.time > merged.back().time)
+			{
+				merged.push_back(subset);
+			}
+		};
+		size_t a = 0, b = 0;
+		while (a < frontier.size() || b < with.size())
+		{
+			if (b == with.size() || (a < frontier.size() && !cheaper(with[b], frontier[a])))
+			{
+				keep(frontier[a++]);
+			}
+			else
+			{
+				keep(with[b++]);
+			}
+		}
+		frontier.swap(merged);
+	}
+	return frontier;
+}
+
+
+// Compute an optimal set of ride items by meeting in the middle.
+// The rides are split in two halves, the Pareto frontier of each half's subsets is
+// enumerated, and a two-pointer sweep pairs every subset of one half with the best subset of
+// the other that still fits. This takes O(2^(n/2) * n) time and O(2^(n/2)) memory at worst,
+// independent of the budget, so it suits n of about 40 to 60 with budgets too large for
+// dynamic_max_time. Dominated subsets are dropped as they are found, which usually keeps the
+// frontiers far smaller than 2^(n/2).
+// Only the first 63 ride items are considered; the rides are returned in ride order.
+// When several subsets tie on time, any one of them may be returned.
+std::unique_ptr<RideVector> meet_in_middle_max_time
+(
+	const RideVector& rides,
+	double total_cost
+)
+{
+	std::unique_ptr<RideVector> result(new RideVector);
+	if (total_cost < 0)
+	{
+		return result;
+	}
+
+	int n = std::min<int>(rides.size(), 63);
+	std::vector<int> costs;
+	std::vector<double> times;
+	exhaustive_fields(rides, n, costs, times);
+
+	std::vector<HalfSubset>
+		lower = meet_in_middle_frontier(costs, times, 0, n / 2, total_cost),
+		upper = meet_in_middle_frontier(costs, times, n / 2, n, total_cost);
+
+	// Both frontiers include the empty subset, so some pair always fits
+	double best_time = 0;
+	uint64_t best_mask = 0;
+	size_t u = upper.size();
+	for (const HalfSubset& subset : lower)
+	{
+		while (u > 0 && subset.cost + upper[u - 1].cost > total_cost)
+		{
+			u--;
+		}
+		if (u == 0)
+		{
+			break;
+		}
+		double time = subset.time + upper[u - 1].time;
+		if (time > best_time)
+		{
+			best_time = time;
+			best_mask = subset.mask | upper[u - 1].mask;
+		}
+	}
+
+	for (uint64_t rest = best_mask; rest != 0; rest &= rest - 1)
+	{
+		result->push_back(rides[lowest_set_bit(rest)]);
+	}
+	return result;
+}
+
+
+// Limits on the work done by branch_and_bound_max_time; zero means no limit.
+struct BranchAndBoundOptions
+{
+	// Stop after expanding this many search nodes.
+	size_t node_limit = 0;
+
+	// Stop after this many seconds of wall-clock time.
+	double time_limit_seconds = 0;
+};
+
+
+// What branch_and_bound_max_time proved about the rides it returned.
+struct BranchAndBoundStats
+{
+	// Search nodes expanded
+	size_t nodes = 0;
+
+	// Total time of the returned rides
+	double best_time = 0;
+
+	// No set of rides within the budget has more total time than this
+	double upper_bound = 0;
+
+	// upper_bound - best_time; zero once the search has proven the returned rides optimal
+	double gap = 0;
+
+	// Whether the search ran to completion, rather than stopping at a limit
+	bool optimal = false;
+};
+
+
+// Depth-first search state of branch_and_bound_max_time.
+// The rides are sorted by decreasing time per dollar, so that the fractional knapsack bound of
+// a node (fill the remaining budget greedily, taking a fraction of the first ride that doesn't
+// fit) is a prefix sum plus one partial ride, found by binary search.
+class BranchAndBoundSearch
+{
+	//
+	public:
+
+		//
+		BranchAndBoundSearch
+		(
+			const std::vector<int>& costs,
+			const std::vector<double>& times,
+			int64_t total_cost,
+			const BranchAndBoundOptions& options
+		)
+			:
+			_costs(costs),
+			_times(times),
+			_total_cost(total_cost),
+			_options(options),
+			_prefix_cost(costs.size() + 1, 0),
+			_prefix_time(times.size() + 1, 0),
+			_path(costs.size(), false),
+			_best(costs.size(), false)
+		{
+			for (size_t k = 0; k < costs.size(); k++)
+			{
+				_prefix_cost[k + 1] = _prefix_cost[k] + costs[k];
+				_prefix_time[k + 1] = _prefix_time[k] + times[k];
+			}
+		}
+
+		// Search the whole tree, or until a limit is hit, and fill in stats.
+		// Returns which of the sorted rides the best solution takes.
+		const std::vector<bool>& run(BranchAndBoundStats& stats)
+		{
+			search(0, 0, 0);
+			stats.nodes = _nodes;
+			stats.best_time = _best_time;
+			stats.optimal = !_stopped;
+			stats.upper_bound = _stopped ? std::max(_best_time, _open_bound) : _best_time;
+			stats.gap = stats.upper_bound - stats.best_time;
+			return _best;
+		}
+
+	//
+	private:
+
+		// Fractional knapsack bound on the time that rides k, k+1, ... can add within capacity.
+		double bound(size_t k, int64_t capacity) const
+		{
+			// Last r such that rides [k, r) all fit
+			size_t lo = k, hi = _costs.size();
+			while (lo < hi)
+			{
+				size_t mid = hi - (hi - lo) / 2;
+				if (_prefix_cost[mid] - _prefix_cost[k] <= capacity)
+				{
+					lo = mid;
+				}
+				else
+				{
+					hi = mid - 1;
+				}
+			}
+			double time = _prefix_time[lo] - _prefix_time[k];
+			if (lo < _costs.size())
+			{
+				time += _times[lo] * double(capacity - (_prefix_cost[lo] - _prefix_cost[k])) / _costs[lo];
+			}
+			return time;
+		}
+
+		//
+		bool out_of_budget()
+		{
+			if (_options.node_limit > 0 && _nodes >= _options.node_limit)
+			{
+				return true;
+			}
+			return _options.time_limit_seconds > 0
+				&& _nodes % 1024 == 0
+				&& _timer.elapsed() >= _options.time_limit_seconds;
+		}
+
+		// Node deciding ride k, with the given totals for the rides taken before it.
+		void search(size_t k, int64_t cost, double time)
+		{
+			if (!_stopped && out_of_budget())
+			{
+				_stopped = true;
+			}
+			if (_stopped)
+			{
+				// Left unexplored; it can still hold anything up to its bound
+				_open_bound = std::max(_open_bound, time + bound(k, _total_cost - cost));
+				return;
+			}
+			_nodes++;
+
+			if (time > _best_time)
+			{
+				_best_time = time;
+				_best = _path;
+			}
+			if (k == _costs.size() || time + bound(k, _total_cost - cost) <= _best_time)
+			{
+				return;
+			}
+
+			if (cost + _costs[k] <= _total_cost)
+			{
+				_path[k] = true;
+				search(k + 1, cost + _costs[k], time + _times[k]);
+				_path[k] = false;
+			}
+			search(k + 1, cost, time);
+		}
+
+		//
+		const std::vector<int>& _costs;
+		const std::vector<double>& _times;
+		const int64_t _total_cost;
+		const BranchAndBoundOptions& _options;
+		std::vector<int64_t> _prefix_cost;
+		std::vector<double> _prefix_time;
+
+		// Decisions on the current search path, and for the best solution so far
+		std::vector<bool> _path, _best;
+		double _best_time = 0;
+
+		//
+		Timer _timer;
+		size_t _nodes = 0;
+		bool _stopped = false;
+
+		// Greatest bound of the subtrees left unexplored after stopping
+		double _open_bound = 0;
+};
+
+
+// Compute a set of ride items with a branch and bound search.
+// Rides are tried in decreasing order of time per dollar, taking each ride before skipping it,
+// and subtrees whose fractional knapsack bound can't beat the best solution so far are pruned.
+// This typically visits a tiny fraction of the subsets exhaustive_max_time does.
+// The search stops early at the limits in options, returning the best solution found so far;
+// stats reports how far from optimal that solution can be. The rides are returned in ride order.
+std::unique_ptr<RideVector> branch_and_bound_max_time
+(
+	const RideVector& rides,
+	double total_cost,
+	const BranchAndBoundOptions& options,
+	BranchAndBoundStats& stats
+)
+{
+	std::unique_ptr<RideVector> result(new RideVector);
+	stats = BranchAndBoundStats();
+	if (total_cost < 0)
 	{
-		std::cout << "[too large]" << std::endl;
+		stats.optimal = true;
+		return result;
 	}
-	else
+
+	// Rides that can never help are left out of the search
+	std::vector<size_t> order;
+	for (size_t i = 0; i < rides.size(); i++)
+	{
+		if (rides[i]->time() > 0 && rides[i]->cost() <= total_cost)
+		{
+			order.push_back(i);
+		}
+	}
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+	{
+		return rides[a]->time() * rides[b]->cost() > rides[b]->time() * rides[a]->cost();
+	});
+
+	std::vector<int> costs(order.size());
+	std::vector<double> times(order.size());
+	for (size_t k = 0; k < order.size(); k++)
+	{
+		costs[k] = rides[order[k]]->cost();
+		times[k] = rides[order[k]]->time();
+	}
+
+	BranchAndBoundSearch search(costs, times, int64_t(std::floor(total_cost)), options);
+	const std::vector<bool>& taken = search.run(stats);
+
+	std::vector<size_t> chosen;
+	for (size_t k = 0; k < order.size(); k++)
+	{
+		if (taken[k])
+		{
+			chosen.push_back(order[k]);
+		}
+	}
+	std::sort(chosen.begin(), chosen.end());
+	for (size_t i : chosen)
+	{
+		result->push_back(rides[i]);
+	}
+
+	// Report the totals as sum_ride_vector sees them, i.e. summed in ride order
+	int best_cost;
+	sum_ride_vector(*result, best_cost, stats.best_time);
+	stats.upper_bound = stats.optimal ? stats.best_time : std::max(stats.upper_bound, stats.best_time);
+	stats.gap = stats.upper_bound - stats.best_time;
+	return result;
+}
+
+
+// branch_and_bound_max_time without limits, run to a proven optimum.
+std::unique_ptr<RideVector> branch_and_bound_max_time
+(
+	const RideVector& rides,
+	double total_cost
+)
+{
+	BranchAndBoundStats stats;
+	return branch_and_bound_max_time(rides, total_cost, BranchAndBoundOptions(), stats);
+}
+
+
+// What an approximate engine guarantees about the rides it returned.
+struct ApproximateStats
+{
+	// Total time of the returned rides
+	double time = 0;
+
+	// The returned time is at least ratio times the best possible
+	double ratio = 0;
+
+	// No set of rides within the budget has more total time than this
+	double upper_bound = 0;
+};
+
+
+// Positions of the rides worth considering for total_cost, see preprocess_rides, sorted by
+// decreasing time per dollar, ties going to the earlier ride.
+RideIndexList ratio_order(const RideVector& rides, int total_cost, bool prune_dominated)
+{
+	PreprocessOptions options;
+	options.prune_dominated = prune_dominated;
+	PreprocessStats stats;
+	RideIndexList order = preprocess_rides(rides, total_cost, options, stats);
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+	{
+		return rides[a]->time() * rides[b]->cost() > rides[b]->time() * rides[a]->cost();
+	});
+	return order;
+}
+
+
+// The chosen positions as rides, in ride order, with their total time in stats.
+std::unique_ptr<RideVector> approximate_result(const RideVector& rides, RideIndexList chosen, ApproximateStats& stats)
+{
+	std::sort(chosen.begin(), chosen.end());
+	std::unique_ptr<RideVector> result = select_rides(rides, chosen);
+	int cost;
+	sum_ride_vector(*result, cost, stats.time);
+	return result;
+}
+
+
+// Greedy pass of greedy_max_time over rides in ratio order: the chosen positions, and the
+// fractional knapsack bound, which is the greedy prefix plus a fraction of the first ride
+// that doesn't fit.
+RideIndexList greedy_select(const RideVector& rides, const RideIndexList& order, int total_cost, double& upper_bound)
+{
+	RideIndexList chosen;
+	int64_t room = total_cost;
+	double time = 0, best_single = 0;
+	bool fractional = false;
+	size_t single = order.size();
+	for (size_t i : order)
+	{
+		int cost = rides[i]->cost();
+		if (rides[i]->time() > best_single)
+		{
+			best_single = rides[i]->time();
+			single = i;
+		}
+		if (cost <= room)
+		{
+			chosen.push_back(i);
+			room -= cost;
+			time += rides[i]->time();
+		}
+		else if (!fractional)
+		{
+			upper_bound = time + rides[i]->time() * double(room) / cost;
+			fractional = true;
+		}
+	}
+	if (!fractional)
+	{
+		upper_bound = time;
+	}
+
+	// The prefix can be arbitrarily bad on its own, but not together with the best single ride
+	if (best_single > time)
+	{
+		chosen.assign(1, single);
+	}
+	return chosen;
+}
+
+
+// Approximate the best set of rides within total_cost, taking rides in decreasing time per
+// dollar while they fit, or the single longest ride if that is better. Within a factor of 2
+// of the optimum, i.e. stats.ratio is 0.5, in O(n log n) time. Rides are returned in ride
+// order.
+std::unique_ptr<RideVector> greedy_max_time
+(
+	const RideVector& rides,
+	int total_cost,
+	ApproximateStats& stats
+)
+{
+	stats = ApproximateStats();
+	RideIndexList order = ratio_order(rides, total_cost, false);
+	RideIndexList chosen = greedy_select(rides, order, total_cost, stats.upper_bound);
+	std::unique_ptr<RideVector> result = approximate_result(rides, chosen, stats);
+	stats.ratio = 0.5;
+	stats.upper_bound = std::min(stats.upper_bound, 2 * stats.time);
+	return result;
+}
+
+
+// greedy_max_time, without the statistics.
+std::unique_ptr<RideVector> greedy_max_time(const RideVector& rides, int total_cost)
+{
+	ApproximateStats stats;
+	return greedy_max_time(rides, total_cost, stats);
+}
+
+
+// Approximate the best set of rides within total_cost to within a factor of 1 - epsilon,
+// for 0 < epsilon < 1, with a fully polynomial approximation scheme.
+// The greedy result g is within a factor of 2, so the optimum lies in [g, 2g]. Times are
+// divided by k = epsilon * g / n and rounded down, which loses less than k per ride and so
+// less than epsilon times the optimum over a whole plan; a dynamic algorithm over the rounded
+// times then finds the cheapest way to reach every rounded total up to 2n / epsilon, and the
+// largest total within budget wins. Rides are first reduced as by preprocess_rides with
+// dominance pruning, which keeps the optimum. Takes O(n^2 / epsilon) time and
+// n * 2n / epsilon bits, independent of the budget. Rides are returned in ride order.
+std::unique_ptr<RideVector> fptas_max_time
+(
+	const RideVector& rides,
+	int total_cost,
+	double epsilon,
+	ApproximateStats& stats
+)
+{
+	assert(epsilon > 0 && epsilon < 1);
+	stats = ApproximateStats();
+	RideIndexList order = ratio_order(rides, total_cost, true);
+	double upper_bound;
+	RideIndexList greedy = greedy_select(rides, order, total_cost, upper_bound);
+	double lower_bound = 0;
+	for (size_t i : greedy)
+	{
+		lower_bound += rides[i]->time();
+	}
+	if (order.empty() || lower_bound <= 0)
+	{
+		std::unique_ptr<RideVector> result = approximate_result(rides, greedy, stats);
+		stats.ratio = 1;
+		stats.upper_bound = stats.time;
+		return result;
+	}
+
+	size_t n = order.size();
+	double scale = epsilon * lower_bound / double(n);
+	size_t totals = size_t(std::ceil(2 * double(n) / epsilon)) + 1;
+	std::vector<int> profits(n);
+	for (size_t k = 0; k < n; k++)
+	{
+		profits[k] = int(std::min(rides[order[k]]->time() / scale, double(totals - 1)));
+	}
+
+	// cheapest[p]: least cost reaching rounded total p with the rides so far
+	const int64_t unreachable = std::numeric_limits<int64_t>::max();
+	std::vector<int64_t> cheapest(totals, unreachable);
+	cheapest[0] = 0;
+	DecisionBitset taken(n, totals);
+	for (size_t k = 0; k < n; k++)
 	{
-		for ( const std::vector<double>& row : cache)
+		int profit = profits[k];
+		int64_t cost = rides[order[k]]->cost();
+		for (size_t p = totals - 1; p >= size_t(profit) && p > 0; p--)
 		{
-			for ( double value : row )
+			if (cheapest[p - profit] != unreachable && cheapest[p - profit] + cost < cheapest[p])
 			{
-				std::cout << std::setw(5) << value;
+				cheapest[p] = cheapest[p - profit] + cost;
+				taken.set(k, p);
 			}
-			std::cout << std::endl;
 		}
 	}
+
+	size_t best = 0;
+	for (size_t p = 0; p < totals; p++)
+	{
+		if (cheapest[p] <= total_cost)
+		{
+			best = p;
+		}
+	}
+	RideIndexList chosen;
+	for (size_t k = n; k > 0; k--)
+	{
+		if (taken.test(k - 1, best))
+		{
+			chosen.push_back(order[k - 1]);
+			best -= profits[k - 1];
+		}
+	}
+
+	std::unique_ptr<RideVector> result = approximate_result(rides, chosen, stats);
+	if (stats.time < lower_bound)
+	{
+		result = approximate_result(rides, greedy, stats);
+	}
+	stats.ratio = 1 - epsilon;
+	stats.upper_bound = std::min(upper_bound, stats.time / stats.ratio);
+	return result;
 }
 
-// Filter the vector source, i.e. create and return a new RideVector containing the subset of
-// the ride items in source that match given criteria.
-// This is intended to:
-//	1) filter out ride with zero or negative time that are irrelevant to our optimization
-//	2) limit the size of inputs to the exhaustive search algorithm since it will probably be slow.
-//
-// Each ride item that is included must have at minimum min_time and at most max_time.
-//	(i.e., each included ride item's time must be between min_time and max_time (inclusive).
-//
-// In addition, the the vector includes only the first total_size ride items that match these criteria.
-std::unique_ptr<RideVector> filter_ride_vector
+
+// fptas_max_time, without the statistics.
+std::unique_ptr<RideVector> fptas_max_time(const RideVector& rides, int total_cost, double epsilon)
+{
+	ApproximateStats stats;
+	return fptas_max_time(rides, total_cost, epsilon, stats);
+}
+
+
+// Approximate the best set of rides within total_cost to within a factor of 1 - epsilon:
+// greedy_max_time when epsilon is at least 1/2, and fptas_max_time otherwise.
+std::unique_ptr<RideVector> approximate_max_time
 (
-	const RideVector& source,
-	double min_time,
-	double max_time,
-	int total_size
+	const RideVector& rides,
+	int total_cost,
+	double epsilon,
+	ApproximateStats& stats
 )
 {
+	if (epsilon >= 0.5)
+	{
+		return greedy_max_time(rides, total_cost, stats);
+	}
+	return fptas_max_time(rides, total_cost, std::max(epsilon, 1e-6), stats);
+}
 
-	std::unique_ptr<RideVector> filtered_rides(new RideVector);
-  std::shared_ptr<RideItem> element = nullptr;
-  for (auto element : source) {
-    if (element->time() >= min_time && element->time() <= max_time && element->time() > 0)
-  	  filtered_rides->push_back(element);
-  	if ((int)filtered_rides->size() >= total_size)
-  		break;
-  }
-	return filtered_rides;
 
+// The better of plan and the greedy plan over the rides at positions, by total time, as
+// the fallback of a solver stopped by a CancellationToken.
+std::unique_ptr<RideVector> anytime_result
+(
+	const RideVector& rides,
+	const RideIndexList& positions,
+	int total_cost,
+	std::unique_ptr<RideVector> plan
+)
+{
+	RideVector candidates = *select_rides(rides, positions);
+	ApproximateStats greedy_stats;
+	std::unique_ptr<RideVector> greedy = greedy_max_time(candidates, total_cost, greedy_stats);
+	int cost;
+	double time;
+	sum_ride_vector(*plan, cost, time);
+	return greedy_stats.time > time ? std::move(greedy) : std::move(plan);
 }
 
-// Compute the optimal set of ride items with a dynamic algorithm.
-// Specifically, among the ride items that fit within a total_cost budget,
-// choose the selection of rides whose time is greatest.
-// Repeat until no more ride items can be chosen, either because we've run out of ride items,
-// or run out of dollars.
+
+// dynamic_max_time, stopping between rows once token asks to.
+// If it stops after the rows of the first k rides, it returns the better of the optimal plan
+// among those k rides, traced back from the rows so far, and the greedy_max_time plan over
+// all rides; either is within the budget. Without divide and conquer the rows are computed as
+// by the rolling row strategy, whatever options.strategy asks for. With it, stopping unwinds
+// the recursion at once, and the plan compared with the greedy one is made of the rides
+// taken among the last rides whose decisions were already made, which is the tail of the
+// optimal plan; progress is then the fraction of the rows of the whole recursion computed.
 std::unique_ptr<RideVector> dynamic_max_time
 (
 	const RideVector& rides,
-	int total_cost
+	int total_cost,
+	const CancellationToken& token,
+	AnytimeStats& stats,
+	const DynamicOptions& options = DynamicOptions()
 )
 {
-  std::vector<std::vector<double>> cache;
-  std::unique_ptr<RideVector> source(new RideVector(rides));
-  std::unique_ptr<RideVector> result(new RideVector);
-  for (int i=0; i<=(int)rides.size(); i++) {
-    cache.push_back(std::vector<double>());
-    for (int j=0; j<=total_cost+1; j++)
-      cache.at(i).push_back(0.0);
-  }
-  double results = 0.0;
-  for (int i = 1; i<= (int)rides.size();i++) {
-    for (int j =1; j<= total_cost; j++) {
-      std::shared_ptr<RideItem> item = rides[i-1];
-      if ((j-item->cost())>=0)
-        results = std::max((item->time()+ cache[i-1][j-item->cost()]), cache[i-1][j]);
-      else {
-        results = cache[i-1][j];
-			}
-      cache[i][j]=results;
-    }
-  }
-  double tempcost = total_cost;
-  for (int i = (int)rides.size(); i >0; i--) {
-    if (cache[i][tempcost]== cache[i-1][tempcost]){
-      continue;
-    }
-    else {
-    result-> push_back(source->at(i-1));
-    tempcost-=(rides.at(i-1))->cost();
-    }
+	stats = AnytimeStats();
+	DynamicProblem problem = dynamic_problem(rides, total_cost);
+	size_t n = problem.costs.size();
+	RideIndexList all(n);
+	std::iota(all.begin(), all.end(), size_t(0));
+	if (problem.total_cost < 0)
+	{
+		stats.complete = true;
+		stats.progress = 1;
+		return std::unique_ptr<RideVector>(new RideVector);
+	}
+
+	KnapsackRowKernel kernel = knapsack_row_kernel(options.kernel);
+	size_t rows_done = 0;
+	if (dynamic_strategy(problem, options) == DynamicStrategy::divide_and_conquer)
+	{
+		bool stopped = false;
+		RideIndexList chosen = dynamic_divide_and_conquer(
+			problem,
+			[&](DynamicRow& row, size_t lo, size_t hi, int capacity)
+			{
+				for (size_t i = lo; i < hi && !(stopped = stopped || token.is_cancelled()); i++)
+				{
+					kernel(row.data(), row.data(), nullptr, 0, capacity, problem.costs[i], problem.times[i]);
+					rows_done++;
+				}
+			},
+			&stopped
+		);
+		if (!stopped)
+		{
+			stats.complete = true;
+			stats.progress = 1;
+			return select_rides(rides, chosen);
+		}
+		stats.progress = double(rows_done) / double(dynamic_divide_and_conquer_row_count(0, n));
+		return anytime_result(rides, all, total_cost, select_rides(rides, chosen));
+	}
+
+	DynamicRow best(problem.total_cost + 1, 0.0);
+	DecisionBitset taken(n, problem.total_cost + 1);
+	for (; rows_done < n && !token.is_cancelled(); rows_done++)
+	{
+		kernel(best.data(), best.data(), taken.row(rows_done), 0, problem.total_cost, problem.costs[rows_done], problem.times[rows_done]);
+	}
+
+	stats.progress = n > 0 ? double(rows_done) / double(n) : 1;
+	stats.complete = rows_done == n;
+	DynamicProblem prefix = problem;
+	prefix.costs.resize(rows_done);
+	prefix.times.resize(rows_done);
+	std::unique_ptr<RideVector> plan = select_rides(rides, dynamic_traceback(prefix, taken));
+	if (stats.complete)
+	{
+		return plan;
 	}
-  return result;
+	return anytime_result(rides, all, total_cost, std::move(plan));
 }
 
-std::vector<std::vector<RideItem>> getTimeSubsets(std::vector<RideItem> source)
+
+// exhaustive_max_time, checking token every few thousand subsets.
+// If it stops early, it returns the better of the best subset visited so far and the
+// greedy_max_time plan over the same first 63 rides.
+std::unique_ptr<RideVector> exhaustive_max_time
+(
+	const RideVector& rides,
+	double total_cost,
+	const CancellationToken& token,
+	AnytimeStats& stats
+)
 {
-    std::vector<std::vector<RideItem>> subset, subTemp;
+	stats = AnytimeStats();
+	int n = std::min<int>(rides.size(), 63);
+	std::vector<int> costs;
+	std::vector<double> times;
+	double tolerance = exhaustive_fields(rides, n, costs, times);
 
-    std::vector<RideItem> temp;
-    subset.push_back(temp);
+	ExhaustiveBest best;
+	uint64_t visited = 0;
+	stats.complete = exhaustive_gray_walk(costs, times, n, 0, total_cost, tolerance, best, &token, &visited);
+	stats.progress = double(visited) / std::ldexp(1.0, n);
+	std::unique_ptr<RideVector> plan = exhaustive_result(rides, best);
+	if (stats.complete)
+	{
+		return plan;
+	}
 
-    for(int i = 0; i < source.size(); i++)
-    {
-        subTemp = subset;
-        for(int j = 0; j < subTemp.size(); j++){subTemp[j].push_back(source[i]);}
-        for(int k = 0; k < subTemp.size(); k++){subset.push_back(subTemp[k]);}
-    }
-    return subset;
+	RideIndexList first(n);
+	std::iota(first.begin(), first.end(), size_t(0));
+	int budget = total_cost >= double(std::numeric_limits<int>::max()) ? std::numeric_limits<int>::max() : int(std::floor(total_cost));
+	return anytime_result(rides, first, budget, std::move(plan));
 }
 
-// Compute the optimal set of ride items with a exhaustive search algorithm.
-// Specifically, among all subsets of ride items,
-// return the subset whose dollars cost fits within the total_cost budget,
-// and whose total time is greatest.
-// To avoid overflow, the size of the ride items vector must be less than 64.
 
-std::unique_ptr<RideVector> exhaustive_max_time
+// Engines solve_max_time can dispatch to.
+enum class SolverEngine
+{
+	// dynamic_max_time, or parallel_dynamic_max_time with more than one thread
+	dynamic,
+
+	// exhaustive_max_time, or parallel_exhaustive_max_time with more than one thread
+	exhaustive,
+
+	// meet_in_middle_max_time
+	meet_in_middle,
+
+	// branch_and_bound_max_time, stopped at SolveOptions::time_limit_seconds
+	branch_and_bound
+};
+
+
+// Human-readable name of an engine, e.g. "dynamic".
+const char* solver_engine_name(SolverEngine engine)
+{
+	switch (engine)
+	{
+		case SolverEngine::dynamic: return "dynamic";
+		case SolverEngine::exhaustive: return "exhaustive";
+		case SolverEngine::meet_in_middle: return "meet_in_middle";
+		case SolverEngine::branch_and_bound: return "branch_and_bound";
+	}
+	return "unknown";
+}
+
+
+// Resources solve_max_time may use, and the cost model it plans with.
+struct SolveOptions
+{
+	// Largest working set any engine may allocate, in bytes.
+	size_t memory_limit_bytes = size_t(1) << 30;
+
+	// Threads for the engines that have parallel versions.
+	size_t threads = 1;
+
+	// Engines predicted to take longer than this are passed over for branch_and_bound,
+	// which is stopped at this deadline; zero means no deadline.
+	double time_limit_seconds = 0;
+
+	// Seconds per unit of work of each engine: a DP cell, an exhaustive subset, and a
+	// frontier entry of the meet in the middle search. Measured with -O2 on one recent
+	// x86 core; only their ratios affect which engine is chosen.
+	double seconds_per_dynamic_cell = 1e-9;
+	double seconds_per_exhaustive_subset = 2e-9;
+	double seconds_per_half_subset = 1e-8;
+};
+
+
+// One engine's predicted cost for a solve_max_time call.
+struct SolverEstimate
+{
+	SolverEngine engine;
+
+	// Whether the engine can solve the problem exactly at all
+	bool applicable;
+
+	double seconds;
+	double bytes;
+};
+
+
+// What solve_max_time decided, and how it went.
+struct SolveReport
+{
+	// The engine that was run, and its estimate
+	SolverEngine engine = SolverEngine::dynamic;
+	double predicted_seconds = 0;
+	double predicted_bytes = 0;
+
+	// Wall-clock time of the engine run
+	double actual_seconds = 0;
+
+	// Greatest common divisor of the ride costs, which divides the width of the DP
+	int cost_gcd = 1;
+
+	// Every engine's estimate, in SolverEngine order
+	std::vector<SolverEstimate> estimates;
+};
+
+
+// Predict the runtime and memory of each engine on the given problem.
+std::vector<SolverEstimate> estimate_max_time
 (
 	const RideVector& rides,
-	double total_cost
+	int total_cost,
+	const SolveOptions& options,
+	int cost_gcd
 )
 {
-	int n = rides.size();
-	if (n > 64) { n = 64; }
-	std::unique_ptr<RideVector> best (new RideVector);
-	for (size_t bits =0; bits<= pow(2,n); bits++) {
-		std::unique_ptr<RideVector> candidate(new RideVector);
-		for (int j = 0; j < n; j++) {
-			if ((bits >> j & 1) == 1) {
-				candidate->push_back(rides.at(j));
-			}
+	double n = double(rides.size());
+	double threads = double(std::max<size_t>(options.threads, 1));
+	double columns = double(std::max(total_cost, 0) / cost_gcd) + 1;
+	double fields = n * (sizeof(int) + sizeof(double));
+
+	std::vector<SolverEstimate> estimates;
+
+	// Rolling row with its decision bitset, or divide and conquer once that doesn't fit,
+	// which recomputes about half the rows at each of its log2(n) levels
+	SolverEstimate dynamic = { SolverEngine::dynamic, true, n * columns * options.seconds_per_dynamic_cell / threads, 0 };
+	dynamic.bytes = n * columns / 8 + 2 * columns * sizeof(double) + fields;
+	if (dynamic.bytes > double(options.memory_limit_bytes))
+	{
+		double levels = std::max(1.0, std::ceil(std::log2(std::max(n, 1.0))));
+		dynamic.seconds *= std::max(1.0, levels / 2);
+		dynamic.bytes = (levels + 2) * columns * sizeof(double) + fields;
+	}
+	estimates.push_back(dynamic);
+
+	// Only the first 63 rides fit in a subset mask
+	bool maskable = rides.size() <= 63;
+	estimates.push_back(SolverEstimate{
+		SolverEngine::exhaustive,
+		maskable,
+		std::ldexp(options.seconds_per_exhaustive_subset, int(std::min(n, 1000.0))) / threads,
+		fields
+	});
+
+	// Worst case, with no subset dominated: two frontiers of 2^(n/2) entries, each
+	// merged with a copy of itself
+	double half = std::ceil(n / 2);
+	estimates.push_back(SolverEstimate{
+		SolverEngine::meet_in_middle,
+		maskable,
+		std::ldexp(options.seconds_per_half_subset * half, int(std::min(half, 1000.0))),
+		std::ldexp(6.0 * sizeof(HalfSubset), int(std::min(half, 1000.0))) + fields
+	});
+
+	// Unpredictable, so it's only the fallback; it runs until the deadline at most
+	estimates.push_back(SolverEstimate{
+		SolverEngine::branch_and_bound,
+		true,
+		options.time_limit_seconds > 0 ? options.time_limit_seconds : HUGE_VAL,
+		4 * fields
+	});
+
+	return estimates;
+}
+
+
+// Compute an optimal set of ride items with whichever engine is predicted to be cheapest.
+// Engines are estimated from the number of rides, the budget, the greatest common divisor of
+// the costs and the memory limit; the fastest exact engine that fits in memory (and, with a
+// time limit, in time) is run, and branch_and_bound_max_time is the fallback when none does.
+// report says which engine ran, and its predicted and actual runtime.
+// The order of the returned rides depends on the engine.
+std::unique_ptr<RideVector> solve_max_time
+(
+	const RideVector& rides,
+	int total_cost,
+	const SolveOptions& options,
+	SolveReport& report
+)
+{
+	report = SolveReport();
+	report.cost_gcd = ride_cost_gcd(rides);
+	report.estimates = estimate_max_time(rides, total_cost, options, report.cost_gcd);
+
+	const SolverEstimate* chosen = &report.estimates.back();
+	for (const SolverEstimate& estimate : report.estimates)
+	{
+		if (estimate.engine != SolverEngine::branch_and_bound
+			&& estimate.applicable
+			&& estimate.bytes <= double(options.memory_limit_bytes)
+			&& (options.time_limit_seconds <= 0 || estimate.seconds <= options.time_limit_seconds)
+			&& (chosen->engine == SolverEngine::branch_and_bound || estimate.seconds < chosen->seconds))
+		{
+			chosen = &estimate;
 		}
-		int* total_cost_candidate = new int();
-		double* total_time_candidate = new double();
-		sum_ride_vector(*candidate, *total_cost_candidate, *total_time_candidate);
-		int* total_cost_main = new int();
-		double* total_time_main = new double();
-		sum_ride_vector(*best, *total_cost_main, *total_time_main);
-		if (*total_cost_candidate <= total_cost) {
-			if (best -> empty() || *total_time_candidate > *total_time_main) {
-				*best = *candidate;
-			}
+	}
+	report.engine = chosen->engine;
+	report.predicted_seconds = chosen->seconds;
+	report.predicted_bytes = chosen->bytes;
+
+	Timer timer;
+	std::unique_ptr<RideVector> result;
+	switch (report.engine)
+	{
+		case SolverEngine::dynamic:
+		{
+			// Switch to divide and conquer where the bitset would pass the memory limit
+			DynamicOptions dynamic;
+			dynamic.divide_and_conquer_cells = options.memory_limit_bytes * 8;
+			result = options.threads > 1
+				? parallel_dynamic_max_time(rides, total_cost, options.threads, dynamic)
+				: dynamic_max_time(rides, total_cost, dynamic);
+			break;
+		}
+		case SolverEngine::exhaustive:
+			result = options.threads > 1
+				? parallel_exhaustive_max_time(rides, total_cost, options.threads)
+				: exhaustive_max_time(rides, total_cost);
+			break;
+		case SolverEngine::meet_in_middle:
+			result = meet_in_middle_max_time(rides, total_cost);
+			break;
+		case SolverEngine::branch_and_bound:
+		{
+			BranchAndBoundOptions limits;
+			limits.time_limit_seconds = options.time_limit_seconds;
+			BranchAndBoundStats stats;
+			result = branch_and_bound_max_time(rides, total_cost, limits, stats);
+			break;
 		}
 	}
-	return best;
+	report.actual_seconds = timer.elapsed();
+	return result;
+}
+
+
+// solve_max_time, for callers that don't need the report.
+std::unique_ptr<RideVector> solve_max_time
+(
+	const RideVector& rides,
+	int total_cost,
+	const SolveOptions& options = SolveOptions()
+)
+{
+	SolveReport report;
+	return solve_max_time(rides, total_cost, options, report);
 }
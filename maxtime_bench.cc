@@ -0,0 +1,451 @@
+///////////////////////////////////////////////////////////////////////////////
+// maxtime_bench.cc
+//
+// Benchmarks of the engines in maxtime.hh.
+//
+// Every engine is timed on a sweep of ride counts, taken from ride.csv with
+// filter_ride_vector and from synthetic catalogs, and of budgets. Each
+// measurement runs in a child process, so the peak RSS reported is that of
+// one engine on one case; it is preceded by warmup runs that are not timed.
+//
+// How to use:
+//
+//    make maxtime_bench
+//    ./maxtime_bench --repeats 9 --csv bench.csv --json bench.json
+//    ./maxtime_bench --quick           // a smaller sweep, CSV to stdout
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+#include "maxtime.hh"
+#include "timer.hh"
+
+
+// A catalog and budget to run every engine on.
+struct BenchCase
+{
+	std::string catalog;
+	int budget;
+	std::shared_ptr<RideVector> rides;
+};
+
+
+// An engine under test. limit is the largest number of rides it is run on, and work is the
+// number of DP cells, or subsets, it evaluates for a case; 0 when that isn't meaningful.
+struct BenchEngine
+{
+	std::string name;
+	size_t limit;
+	std::function<bool(int budget)> applies;
+	std::function<std::unique_ptr<RideVector>(const RideVector& rides, int budget)> run;
+	std::function<double(const RideVector& rides, int budget)> work;
+};
+
+
+// Timings of one engine on one case, in seconds, and what the engine answered.
+struct BenchResult
+{
+	std::vector<double> seconds;
+	double total_time = 0;
+	int total_cost = 0;
+	long peak_rss_kib = 0;
+};
+
+
+// sorted, which is not empty, at quantile q, by the nearest-rank method.
+double bench_quantile(const std::vector<double>& sorted, double q)
+{
+	size_t rank = size_t(std::ceil(q * sorted.size()));
+	return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+
+// n rides with costs uniform in [1, max_cost] times cost_step and times uniform in
+// [1, 120) minutes, the same ones for the same seed.
+std::shared_ptr<RideVector> synthetic_rides(size_t n, int max_cost, int cost_step, uint64_t seed)
+{
+	std::mt19937_64 random(seed);
+	std::uniform_int_distribution<int> cost(1, max_cost);
+	std::uniform_real_distribution<double> time(1, 120);
+	auto rides = std::make_shared<RideVector>();
+	rides->reserve(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		std::string description = "synthetic " + std::to_string(i);
+		int c = cost(random) * cost_step;
+		rides->push_back(std::shared_ptr<RideItem>(new RideItem(description, c, std::round(time(random) * 100) / 100)));
+	}
+	return rides;
+}
+
+
+// DP cells of the dynamic algorithm: a row per ride, a column per budget step.
+double dynamic_cells(const RideVector& rides, int budget)
+{
+	return double(rides.size()) * (budget / ride_cost_gcd(rides) + 1);
+}
+
+
+// Subsets of the exhaustive search.
+double exhaustive_subsets(const RideVector& rides, int)
+{
+	return std::ldexp(1.0, int(std::min<size_t>(rides.size(), 63)));
+}
+
+
+// The engines of maxtime.hh, with the largest catalogs each is practical on.
+std::vector<BenchEngine> bench_engines()
+{
+	size_t threads = std::max(1u, std::thread::hardware_concurrency());
+	auto always = [](int) { return true; };
+	auto no_work = [](const RideVector&, int) { return 0.0; };
+	auto fixed_budget = [](int budget)
+	{
+		for (auto& fixed : fixed_dynamic_budgets)
+		{
+			if (fixed.first == budget)
+			{
+				return true;
+			}
+		}
+		return false;
+	};
+
+	return {
+		{ "dynamic", SIZE_MAX, always,
+			[](const RideVector& rides, int budget) { return dynamic_max_time(rides, budget); }, dynamic_cells },
+		{ "dynamic_full_table", 2000, always,
+			[](const RideVector& rides, int budget)
+			{
+				DynamicOptions options;
+				options.strategy = DynamicStrategy::full_table;
+				return dynamic_max_time(rides, budget, options);
+			},
+			dynamic_cells },
+		{ "dynamic_scalar", SIZE_MAX, always,
+			[](const RideVector& rides, int budget)
+			{
+				DynamicOptions options;
+				options.kernel = KnapsackKernel::scalar;
+				return dynamic_max_time(rides, budget, options);
+			},
+			dynamic_cells },
+		{ "fixed_point_dynamic", SIZE_MAX, always,
+			[](const RideVector& rides, int budget) { return fixed_point_dynamic_max_time(rides, budget); }, dynamic_cells },
+		{ "dynamic_fixed", SIZE_MAX, fixed_budget,
+			[](const RideVector& rides, int budget) { return dynamic_max_time_fixed(rides, budget); }, dynamic_cells },
+		{ "preprocessed_dynamic", SIZE_MAX, always,
+			[](const RideVector& rides, int budget)
+			{
+				PreprocessOptions options;
+				options.prune_dominated = true;
+				return preprocessed_dynamic_max_time(rides, budget, options);
+			},
+			no_work },
+		{ "parallel_dynamic", SIZE_MAX, always,
+			[threads](const RideVector& rides, int budget) { return parallel_dynamic_max_time(rides, budget, threads); }, dynamic_cells },
+		{ "exhaustive", 24, always,
+			[](const RideVector& rides, int budget) { return exhaustive_max_time(rides, budget); }, exhaustive_subsets },
+		{ "parallel_exhaustive", 24, always,
+			[threads](const RideVector& rides, int budget) { return parallel_exhaustive_max_time(rides, budget, threads); }, exhaustive_subsets },
+		{ "meet_in_middle", 40, always,
+			[](const RideVector& rides, int budget) { return meet_in_middle_max_time(rides, budget); }, no_work },
+		{ "branch_and_bound", 1000, always,
+			[](const RideVector& rides, int budget) { return branch_and_bound_max_time(rides, budget); }, no_work },
+		{ "greedy", SIZE_MAX, always,
+			[](const RideVector& rides, int budget) { return greedy_max_time(rides, budget); }, no_work },
+		{ "fptas_0.1", 1000, always,
+			[](const RideVector& rides, int budget) { return fptas_max_time(rides, budget, 0.1); }, no_work },
+		{ "constrained_window_120", 1000, [](int budget) { return budget <= 2000; },
+			[](const RideVector& rides, int budget) { return constrained_max_time(rides, budget, 120); },
+			[](const RideVector& rides, int budget) { return dynamic_cells(rides, budget) * 121; } },
+		{ "solve", SIZE_MAX, always,
+			[](const RideVector& rides, int budget) { return solve_max_time(rides, budget); }, no_work },
+	};
+}
+
+
+// The sweep: small ride.csv catalogs for the dynamic versus exhaustive crossover, then larger
+// ones, and synthetic catalogs, one of them with every cost a multiple of 10.
+std::vector<BenchCase> bench_cases(const RideVector& all_rides, bool quick)
+{
+	std::vector<size_t> small = quick ? std::vector<size_t> { 8, 16, 20 } : std::vector<size_t> { 8, 12, 16, 18, 20, 22, 24 };
+	std::vector<size_t> large = quick ? std::vector<size_t> { 1000 } : std::vector<size_t> { 40, 100, 1000, 8000 };
+	std::vector<int> budgets = quick ? std::vector<int> { 100, 1000 } : std::vector<int> { 100, 500, 2000, 10000 };
+
+	std::vector<BenchCase> cases;
+	for (size_t n : small)
+	{
+		std::shared_ptr<RideVector> rides = filter_ride_vector(all_rides, 1, 2500, n);
+		for (int budget : { 50, 500 })
+		{
+			cases.push_back({ "ride.csv", budget, rides });
+		}
+	}
+	for (size_t n : large)
+	{
+		std::shared_ptr<RideVector> rides = filter_ride_vector(all_rides, 1, 2500, n);
+		for (int budget : budgets)
+		{
+			cases.push_back({ "ride.csv", budget, rides });
+		}
+	}
+	for (size_t n : quick ? std::vector<size_t> { 10000 } : std::vector<size_t> { 10000, 50000 })
+	{
+		std::shared_ptr<RideVector> plain = synthetic_rides(n, 100, 1, n);
+		std::shared_ptr<RideVector> coarse = synthetic_rides(n, 100, 10, n + 1);
+		for (int budget : budgets)
+		{
+			cases.push_back({ "synthetic", budget, plain });
+			cases.push_back({ "synthetic_cost_step_10", budget, coarse });
+		}
+	}
+	return cases;
+}
+
+
+// Run engine on test warmup times untimed, then repeats times timed.
+BenchResult bench_measure(const BenchEngine& engine, const BenchCase& test, int warmup, int repeats)
+{
+	BenchResult result;
+	for (int i = 0; i < warmup; i++)
+	{
+		engine.run(*test.rides, test.budget);
+	}
+	for (int i = 0; i < repeats; i++)
+	{
+		Timer timer;
+		std::unique_ptr<RideVector> chosen = engine.run(*test.rides, test.budget);
+		result.seconds.push_back(timer.elapsed());
+		sum_ride_vector(*chosen, result.total_cost, result.total_time);
+	}
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	result.peak_rss_kib = usage.ru_maxrss;
+	return result;
+}
+
+
+// bench_measure in a child process, so that peak RSS covers this measurement alone.
+// false if the child failed.
+bool bench_isolated(const BenchEngine& engine, const BenchCase& test, int warmup, int repeats, BenchResult& result)
+{
+	int channel[2];
+	if (pipe(channel) != 0)
+	{
+		return false;
+	}
+	std::cout.flush();
+	pid_t child = fork();
+	if (child < 0)
+	{
+		close(channel[0]);
+		close(channel[1]);
+		return false;
+	}
+	if (child == 0)
+	{
+		close(channel[0]);
+		BenchResult measured = bench_measure(engine, test, warmup, repeats);
+		std::ostringstream out;
+		out.precision(17);
+		out << measured.total_cost << ' ' << measured.total_time << ' ' << measured.peak_rss_kib;
+		for (double seconds : measured.seconds)
+		{
+			out << ' ' << seconds;
+		}
+		std::string text = out.str();
+		bool written = write(channel[1], text.data(), text.size()) == ssize_t(text.size());
+		_exit(written ? 0 : 1);
+	}
+
+	close(channel[1]);
+	std::string text;
+	char buffer[4096];
+	for (ssize_t got; (got = read(channel[0], buffer, sizeof(buffer))) > 0; )
+	{
+		text.append(buffer, got);
+	}
+	close(channel[0]);
+	int status;
+	if (waitpid(child, &status, 0) != child || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	{
+		return false;
+	}
+
+	std::istringstream in(text);
+	result = BenchResult();
+	in >> result.total_cost >> result.total_time >> result.peak_rss_kib;
+	for (double seconds; in >> seconds; )
+	{
+		result.seconds.push_back(seconds);
+	}
+	return !result.seconds.empty();
+}
+
+
+// One row of the report.
+struct BenchRow
+{
+	std::string engine, catalog;
+	size_t n;
+	int budget;
+	int repeats;
+	double median, p99, work_per_second, total_time;
+	int total_cost;
+	long peak_rss_kib;
+};
+
+
+//
+void write_csv(std::ostream& out, const std::vector<BenchRow>& rows)
+{
+	out << "engine,catalog,n,budget,repeats,median_seconds,p99_seconds,work_per_second,total_cost,total_time,peak_rss_kib\n";
+	for (const BenchRow& row : rows)
+	{
+		out << row.engine << ',' << row.catalog << ',' << row.n << ',' << row.budget << ',' << row.repeats << ','
+			<< row.median << ',' << row.p99 << ',' << row.work_per_second << ','
+			<< row.total_cost << ',' << row.total_time << ',' << row.peak_rss_kib << '\n';
+	}
+}
+
+
+//
+void write_json(std::ostream& out, const std::vector<BenchRow>& rows)
+{
+	out << "[\n";
+	for (size_t i = 0; i < rows.size(); i++)
+	{
+		const BenchRow& row = rows[i];
+		out << "  {\"engine\": \"" << row.engine << "\", \"catalog\": \"" << row.catalog << "\", \"n\": " << row.n
+			<< ", \"budget\": " << row.budget << ", \"repeats\": " << row.repeats
+			<< ", \"median_seconds\": " << row.median << ", \"p99_seconds\": " << row.p99
+			<< ", \"work_per_second\": " << row.work_per_second
+			<< ", \"total_cost\": " << row.total_cost << ", \"total_time\": " << row.total_time
+			<< ", \"peak_rss_kib\": " << row.peak_rss_kib << "}" << (i + 1 < rows.size() ? "," : "") << "\n";
+	}
+	out << "]\n";
+}
+
+
+int main(int argc, char* argv[])
+{
+	int warmup = 1, repeats = 5;
+	bool quick = false;
+	std::string csv_path, json_path, only;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool has_value = i + 1 < argc;
+		if (arg == "--warmup" && has_value)
+		{
+			warmup = std::max(0, std::atoi(argv[++i]));
+		}
+		else if (arg == "--repeats" && has_value)
+		{
+			repeats = std::max(1, std::atoi(argv[++i]));
+		}
+		else if (arg == "--csv" && has_value)
+		{
+			csv_path = argv[++i];
+		}
+		else if (arg == "--json" && has_value)
+		{
+			json_path = argv[++i];
+		}
+		else if (arg == "--engine" && has_value)
+		{
+			only = argv[++i];
+		}
+		else if (arg == "--quick")
+		{
+			quick = true;
+		}
+		else
+		{
+			std::cerr << "usage: " << argv[0]
+				<< " [--warmup N] [--repeats N] [--engine NAME] [--quick] [--csv PATH] [--json PATH]" << std::endl;
+			return 2;
+		}
+	}
+
+	auto all_rides = load_ride_database("ride.csv");
+	if (!all_rides)
+	{
+		std::cerr << "can't load ride.csv" << std::endl;
+		return 1;
+	}
+
+	std::vector<BenchRow> rows;
+	for (const BenchCase& test : bench_cases(*all_rides, quick))
+	{
+		for (const BenchEngine& engine : bench_engines())
+		{
+			if ((!only.empty() && engine.name != only) || test.rides->size() > engine.limit || !engine.applies(test.budget))
+			{
+				continue;
+			}
+
+			BenchResult result;
+			if (!bench_isolated(engine, test, warmup, repeats, result))
+			{
+				std::cerr << engine.name << " failed on " << test.catalog << " n=" << test.rides->size()
+					<< " budget=" << test.budget << std::endl;
+				continue;
+			}
+
+			std::sort(result.seconds.begin(), result.seconds.end());
+			BenchRow row;
+			row.engine = engine.name;
+			row.catalog = test.catalog;
+			row.n = test.rides->size();
+			row.budget = test.budget;
+			row.repeats = repeats;
+			row.median = bench_quantile(result.seconds, 0.5);
+			row.p99 = bench_quantile(result.seconds, 0.99);
+			double work = engine.work(*test.rides, test.budget);
+			row.work_per_second = work > 0 && row.median > 0 ? work / row.median : 0;
+			row.total_cost = result.total_cost;
+			row.total_time = result.total_time;
+			row.peak_rss_kib = result.peak_rss_kib;
+			rows.push_back(row);
+			std::cerr << row.engine << " " << row.catalog << " n=" << row.n << " budget=" << row.budget
+				<< ": " << row.median << " s" << std::endl;
+		}
+	}
+
+	if (csv_path.empty() && json_path.empty())
+	{
+		write_csv(std::cout, rows);
+	}
+	if (!csv_path.empty())
+	{
+		std::ofstream out(csv_path);
+		write_csv(out, rows);
+	}
+	if (!json_path.empty())
+	{
+		std::ofstream out(json_path);
+		write_json(out, rows);
+	}
+	return 0;
+}
@@ -0,0 +1,238 @@
+///////////////////////////////////////////////////////////////////////////////
+// maxtime_cache.hh
+//
+// Memoized front end for the solvers in maxtime.hh.
+//
+// A MaxTimeCache remembers the rides chosen for recent (ride set, budget)
+// queries, keyed by a 64-bit fingerprint of the costs and times of the ride
+// set, and evicts the least recently used answers past a memory limit.
+//
+// How to use:
+//
+//    MaxTimeCache cache(16 << 20);
+//    auto plan = cache.dynamic_max_time(*rides, 500);   // solved
+//    plan = cache.dynamic_max_time(*rides, 500);        // remembered
+//    std::cout << cache.stats().hits << std::endl;
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "maxtime.hh"
+
+
+// Fingerprint of the costs and times of rides, in order; descriptions are left out, since
+// no solver looks at them. Equal ride sets have equal fingerprints, and different ones
+// collide with probability about 2^-64.
+uint64_t ride_fingerprint(const RideVector& rides)
+{
+	// splitmix64 finalizer, folded over the fields
+	auto mix = [](uint64_t x)
+	{
+		x += 0x9e3779b97f4a7c15ULL;
+		x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+		return x ^ (x >> 31);
+	};
+
+	uint64_t hash = mix(rides.size());
+	for (auto& ride : rides)
+	{
+		double time = ride->time();
+		uint64_t time_bits;
+		std::memcpy(&time_bits, &time, sizeof(time_bits));
+		hash = mix(hash ^ uint64_t(uint32_t(ride->cost())));
+		hash = mix(hash ^ time_bits);
+	}
+	return hash;
+}
+
+
+// Counters of a MaxTimeCache.
+struct MaxTimeCacheStats
+{
+	size_t hits = 0;
+	size_t misses = 0;
+	size_t evictions = 0;
+
+	// Answers held, and the bytes charged for them
+	size_t entries = 0;
+	size_t bytes = 0;
+};
+
+
+// LRU cache of solver answers; see the top of this file.
+// Answers are kept as positions in the ride set, so a hit returns the caller's own RideItems,
+// exactly the rides the solver would have returned. Each answer is charged its positions plus
+// a fixed overhead against memory_limit_bytes. Safe to use from several threads at once;
+// solving on a miss happens outside the lock, so two threads missing on the same query may
+// both solve it.
+class MaxTimeCache
+{
+	//
+	public:
+
+		//
+		explicit MaxTimeCache(size_t memory_limit_bytes = 64 << 20)
+			:
+			_memory_limit(memory_limit_bytes)
+		{}
+
+		MaxTimeCache(const MaxTimeCache&) = delete;
+		MaxTimeCache& operator=(const MaxTimeCache&) = delete;
+
+		// dynamic_max_time(rides, total_cost), remembered.
+		std::unique_ptr<RideVector> dynamic_max_time(const RideVector& rides, int total_cost)
+		{
+			return dynamic_max_time(rides, ride_fingerprint(rides), total_cost);
+		}
+
+		// dynamic_max_time, for a caller that keeps the fingerprint of rides.
+		std::unique_ptr<RideVector> dynamic_max_time(const RideVector& rides, uint64_t fingerprint, int total_cost)
+		{
+			Key key { fingerprint, Engine::dynamic, double(total_cost) };
+			RideIndexList chosen;
+			if (!lookup(key, chosen))
+			{
+				chosen = dynamic_select(dynamic_problem(rides, total_cost), DynamicOptions());
+				insert(key, chosen);
+			}
+			return select_rides(rides, chosen);
+		}
+
+		// exhaustive_max_time(rides, total_cost), remembered.
+		std::unique_ptr<RideVector> exhaustive_max_time(const RideVector& rides, double total_cost)
+		{
+			return exhaustive_max_time(rides, ride_fingerprint(rides), total_cost);
+		}
+
+		// exhaustive_max_time, for a caller that keeps the fingerprint of rides.
+		std::unique_ptr<RideVector> exhaustive_max_time(const RideVector& rides, uint64_t fingerprint, double total_cost)
+		{
+			Key key { fingerprint, Engine::exhaustive, total_cost };
+			RideIndexList chosen;
+			if (!lookup(key, chosen))
+			{
+				chosen = exhaustive_select(rides, total_cost);
+				insert(key, chosen);
+			}
+			return select_rides(rides, chosen);
+		}
+
+		//
+		MaxTimeCacheStats stats() const
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			MaxTimeCacheStats result = _stats;
+			result.entries = _entries.size();
+			result.bytes = _bytes;
+			return result;
+		}
+
+		// Forget every answer; the hit, miss and eviction counters are kept.
+		void clear()
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_index.clear();
+			_entries.clear();
+			_bytes = 0;
+		}
+
+	//
+	private:
+
+		//
+		enum class Engine { dynamic, exhaustive };
+
+		//
+		struct Key
+		{
+			uint64_t fingerprint;
+			Engine engine;
+			double budget;
+
+			bool operator==(const Key& other) const
+			{
+				return fingerprint == other.fingerprint && engine == other.engine && budget == other.budget;
+			}
+		};
+
+		//
+		struct KeyHash
+		{
+			size_t operator()(const Key& key) const
+			{
+				uint64_t budget_bits;
+				std::memcpy(&budget_bits, &key.budget, sizeof(budget_bits));
+				return size_t(key.fingerprint ^ (budget_bits * 0x9e3779b97f4a7c15ULL) ^ uint64_t(key.engine));
+			}
+		};
+
+		//
+		struct Entry
+		{
+			Key key;
+			std::vector<size_t> chosen;
+		};
+
+		// Bytes charged for an entry: its positions, and the list node and index slot
+		static size_t entry_bytes(const Entry& entry)
+		{
+			return sizeof(Entry) + entry.chosen.size() * sizeof(size_t) + 4 * sizeof(void*) + sizeof(Key);
+		}
+
+		// Find key, making it the most recently used.
+		bool lookup(const Key& key, RideIndexList& chosen)
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			auto found = _index.find(key);
+			if (found == _index.end())
+			{
+				_stats.misses++;
+				return false;
+			}
+			_stats.hits++;
+			_entries.splice(_entries.begin(), _entries, found->second);
+			chosen.assign(found->second->chosen.begin(), found->second->chosen.end());
+			return true;
+		}
+
+		// Remember chosen for key, evicting the least recently used entries past the limit.
+		void insert(const Key& key, const RideIndexList& chosen)
+		{
+			Entry entry { key, std::vector<size_t>(chosen.begin(), chosen.end()) };
+			size_t bytes = entry_bytes(entry);
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (bytes > _memory_limit || _index.count(key) > 0)
+			{
+				return;
+			}
+			while (!_entries.empty() && _bytes + bytes > _memory_limit)
+			{
+				_bytes -= entry_bytes(_entries.back());
+				_index.erase(_entries.back().key);
+				_entries.pop_back();
+				_stats.evictions++;
+			}
+			_entries.push_front(std::move(entry));
+			_index.emplace(key, _entries.begin());
+			_bytes += bytes;
+		}
+
+		//
+		const size_t _memory_limit;
+
+		// Guards everything below; entries are most recently used first
+		mutable std::mutex _mutex;
+		std::list<Entry> _entries;
+		std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> _index;
+		size_t _bytes = 0;
+		MaxTimeCacheStats _stats;
+};
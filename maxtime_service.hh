@@ -0,0 +1,306 @@
+///////////////////////////////////////////////////////////////////////////////
+// maxtime_service.hh
+//
+// Asynchronous front end for the solvers in maxtime.hh.
+//
+// A MaxTimeService accepts requests for the best rides within a budget, as
+// futures or callbacks, into a bounded queue. A dispatcher thread drains the
+// queue, groups the requests waiting on the same ride set, and solves each
+// group with one dynamic_max_time_batch pass on a WorkStealingPool.
+//
+// How to use:
+//
+//    MaxTimeService service(4);
+//    std::shared_ptr<const RideVector> rides = ...;
+//    auto plan = service.submit(rides, 500);
+//    service.submit(rides, 800, [](std::unique_ptr<RideVector> rides) { ... });
+//    print_ride_vector(*plan.get());
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "maxtime.hh"
+#include "thread_pool.hh"
+
+
+// First-in first-out queue of at most capacity items, for any number of producers and
+// consumers. Producers block while it is full and consumers while it is empty; after
+// close(), pushes fail and pops drain what is left.
+template <typename T>
+class BoundedQueue
+{
+	//
+	public:
+
+		//
+		explicit BoundedQueue(size_t capacity)
+			:
+			_capacity(capacity > 0 ? capacity : 1),
+			_closed(false)
+		{}
+
+		BoundedQueue(const BoundedQueue&) = delete;
+		BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+		// Add item, waiting for room; false if the queue is closed.
+		bool push(T item)
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_not_full.wait(lock, [this]() { return _closed || _items.size() < _capacity; });
+			if (_closed)
+			{
+				return false;
+			}
+			_items.push_back(std::move(item));
+			lock.unlock();
+			_not_empty.notify_one();
+			return true;
+		}
+
+		// Add item if there is room right now.
+		bool try_push(T item)
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			if (_closed || _items.size() >= _capacity)
+			{
+				return false;
+			}
+			_items.push_back(std::move(item));
+			lock.unlock();
+			_not_empty.notify_one();
+			return true;
+		}
+
+		// Remove the oldest item, waiting for one; false once the queue is closed and empty.
+		bool pop(T& item)
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_not_empty.wait(lock, [this]() { return _closed || !_items.empty(); });
+			if (_items.empty())
+			{
+				return false;
+			}
+			item = std::move(_items.front());
+			_items.pop_front();
+			lock.unlock();
+			_not_full.notify_one();
+			return true;
+		}
+
+		// Remove the oldest item if there is one right now.
+		bool try_pop(T& item)
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			if (_items.empty())
+			{
+				return false;
+			}
+			item = std::move(_items.front());
+			_items.pop_front();
+			lock.unlock();
+			_not_full.notify_one();
+			return true;
+		}
+
+		//
+		void close()
+		{
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_closed = true;
+			}
+			_not_full.notify_all();
+			_not_empty.notify_all();
+		}
+
+		//
+		size_t capacity() const { return _capacity; }
+
+	//
+	private:
+
+		//
+		const size_t _capacity;
+		std::mutex _mutex;
+		std::condition_variable _not_full, _not_empty;
+		std::deque<T> _items;
+		bool _closed;
+};
+
+
+// Called with the rides of a request; nullptr if solving it failed.
+typedef std::function<void(std::unique_ptr<RideVector>)> MaxTimeCallback;
+
+
+// Counters of a MaxTimeService.
+struct MaxTimeServiceStats
+{
+	// Requests answered
+	size_t requests = 0;
+
+	// dynamic_max_time_batch passes run; requests - batches were answered by sharing a pass
+	size_t batches = 0;
+};
+
+
+// Solves dynamic_max_time requests on a pool of threads; see the top of this file.
+// Requests on the same ride set are coalesced when they are waiting in the queue together,
+// which is recognized by the shared_ptr to the rides, so callers asking about one catalog
+// should share one pointer. The answer to each request is the one of dynamic_max_time.
+class MaxTimeService
+{
+	//
+	public:
+
+		//
+		explicit MaxTimeService
+		(
+			size_t threads = 1,
+			size_t queue_capacity = 1024,
+			const DynamicOptions& options = DynamicOptions()
+		)
+			:
+			_options(options),
+			_queue(queue_capacity),
+			_pool(threads),
+			_dispatcher([this]() { dispatch(); })
+		{}
+
+		// Answers every request already submitted, then stops. Once the dispatcher is joined,
+		// ~WorkStealingPool runs the solve() tasks still queued, which use _options and
+		// _stats; those are declared before _pool so they are still alive then.
+		~MaxTimeService()
+		{
+			_queue.close();
+			_dispatcher.join();
+		}
+
+		MaxTimeService(const MaxTimeService&) = delete;
+		MaxTimeService& operator=(const MaxTimeService&) = delete;
+
+		// Ask for the best rides within budget; done is called on a pool thread with them.
+		// Waits while the queue is full.
+		void submit(std::shared_ptr<const RideVector> rides, int budget, MaxTimeCallback done)
+		{
+			bool queued = _queue.push(Request { std::move(rides), budget, std::move(done) });
+			assert(queued);
+			(void)queued;
+		}
+
+		// submit, answering through a future. If solving fails, the future holds the exception.
+		std::future<std::unique_ptr<RideVector>> submit(std::shared_ptr<const RideVector> rides, int budget)
+		{
+			auto promise = std::make_shared<std::promise<std::unique_ptr<RideVector>>>();
+			std::future<std::unique_ptr<RideVector>> result = promise->get_future();
+			submit(std::move(rides), budget, [promise](std::unique_ptr<RideVector> chosen)
+			{
+				if (chosen)
+				{
+					promise->set_value(std::move(chosen));
+				}
+				else
+				{
+					promise->set_exception(std::make_exception_ptr(std::runtime_error("MaxTimeService: solve failed")));
+				}
+			});
+			return result;
+		}
+
+		//
+		MaxTimeServiceStats stats() const
+		{
+			std::lock_guard<std::mutex> lock(_stats_mutex);
+			return _stats;
+		}
+
+	//
+	private:
+
+		//
+		struct Request
+		{
+			std::shared_ptr<const RideVector> rides;
+			int budget;
+			MaxTimeCallback done;
+		};
+
+		// Most requests taken from the queue at once
+		static constexpr size_t drain_limit = 256;
+
+		// Take the waiting requests, group them by ride set, and hand each group to the pool.
+		void dispatch()
+		{
+			Request first;
+			while (_queue.pop(first))
+			{
+				std::map<const RideVector*, std::vector<Request>> groups;
+				groups[first.rides.get()].push_back(std::move(first));
+				Request next;
+				for (size_t taken = 1; taken < drain_limit && _queue.try_pop(next); taken++)
+				{
+					groups[next.rides.get()].push_back(std::move(next));
+				}
+
+				for (auto& group : groups)
+				{
+					auto requests = std::make_shared<std::vector<Request>>(std::move(group.second));
+					_pool.submit([this, requests]() { solve(*requests); });
+				}
+			}
+		}
+
+		// Answer requests, which share one ride set, with a single batched pass.
+		void solve(std::vector<Request>& requests)
+		{
+			std::vector<int> budgets;
+			for (const Request& request : requests)
+			{
+				budgets.push_back(request.budget);
+			}
+
+			std::vector<std::unique_ptr<RideVector>> results;
+			try
+			{
+				results = dynamic_max_time_batch(*requests.front().rides, budgets, _options);
+			}
+			catch (...)
+			{
+				results.clear();
+				results.resize(requests.size());
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(_stats_mutex);
+				_stats.requests += requests.size();
+				_stats.batches++;
+			}
+			for (size_t i = 0; i < requests.size(); i++)
+			{
+				requests[i].done(std::move(results[i]));
+			}
+		}
+
+		// Used by the tasks of _pool, so declared, and alive, before it
+		DynamicOptions _options;
+		mutable std::mutex _stats_mutex;
+		MaxTimeServiceStats _stats;
+
+		//
+		BoundedQueue<Request> _queue;
+		WorkStealingPool _pool;
+
+		// Started last, since it uses everything above
+		std::thread _dispatcher;
+};
@@ -7,10 +7,18 @@
 
 
 #include <cassert>
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
 #include <sstream>
 
 
+// Record the phases of queries, so the instrumentation is tested too
+#define MAXTIME_INSTRUMENT 1
+
 #include "maxtime.hh"
+#include "maxtime_cache.hh"
+#include "maxtime_service.hh"
 #include "rubrictest.hh"
 
 
@@ -127,6 +135,162 @@ int main()
 		}
 	);
 	
+	//
+	rubric.criterion(
+		"DpTable", 1,
+		[&]()
+		{
+			DpTable table(3, 13);
+			TEST_EQUAL("rows", 3, table.rows());
+			TEST_EQUAL("columns", 13, table.columns());
+			TEST_GE("stride", table.stride(), table.columns());
+			for ( size_t i = 0; i < table.rows(); i++ )
+			{
+				TEST_EQUAL("aligned rows", 0, reinterpret_cast<uintptr_t>(table[i]) % DpTable::alignment);
+				for ( size_t j = 0; j < table.columns(); j++ )
+				{
+					TEST_EQUAL("zero-initialized", 0.0, table[i][j]);
+				}
+			}
+			table[2][12] = 4.5;
+			TEST_EQUAL("write", 4.5, table[2][12]);
+			TEST_EQUAL("rows don't overlap", 0.0, table[1][12]);
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"dynamic_max_time rolling row", 2,
+		[&]()
+		{
+			DynamicOptions full, rolling;
+			full.strategy = DynamicStrategy::full_table;
+			rolling.strategy = DynamicStrategy::rolling_row;
+			
+			for ( int budget : { 3, 9, 10, 14 } )
+			{
+				auto expected = dynamic_max_time(trivial_rides, budget, full);
+				auto actual = dynamic_max_time(trivial_rides, budget, rolling);
+				TEST_TRUE("non-null", actual);
+				TEST_TRUE("same rides as the full table", *expected == *actual);
+			}
+			
+			auto expected = dynamic_max_time(*filtered_rides, 500, full);
+			auto actual = dynamic_max_time(*filtered_rides, 500, rolling);
+			TEST_TRUE("non-null", actual);
+			TEST_TRUE("same rides as the full table", *expected == *actual);
+			
+			TEST_TRUE("negative budget", dynamic_max_time(trivial_rides, -1, rolling)->empty());
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"dynamic_max_time divide and conquer", 2,
+		[&]()
+		{
+			DynamicOptions rolling, divide;
+			rolling.strategy = DynamicStrategy::rolling_row;
+			divide.strategy = DynamicStrategy::divide_and_conquer;
+			
+			for ( int budget : { 3, 9, 10, 14 } )
+			{
+				auto expected = dynamic_max_time(trivial_rides, budget, rolling);
+				auto actual = dynamic_max_time(trivial_rides, budget, divide);
+				TEST_TRUE("non-null", actual);
+				TEST_TRUE("same rides as the traceback", *expected == *actual);
+			}
+			
+			auto expected = dynamic_max_time(*filtered_rides, 500, rolling);
+			auto actual = dynamic_max_time(*filtered_rides, 500, divide);
+			TEST_TRUE("non-null", actual);
+			TEST_TRUE("same rides as the traceback", *expected == *actual);
+			
+			DynamicOptions automatic;
+			automatic.divide_and_conquer_cells = 1000;
+			actual = dynamic_max_time(*filtered_rides, 500, automatic);
+			TEST_TRUE("automatic switches past the threshold", *expected == *actual);
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"dynamic_max_time kernels", 2,
+		[&]()
+		{
+			DynamicOptions scalar;
+			scalar.kernel = KnapsackKernel::scalar;
+			auto expected_small = dynamic_max_time(*filtered_rides, 500, scalar);
+			auto expected_trivial = dynamic_max_time(trivial_rides, 14, scalar);
+			
+			for ( auto kernel : { KnapsackKernel::automatic, KnapsackKernel::avx2, KnapsackKernel::avx512, KnapsackKernel::neon } )
+			{
+				for ( auto strategy : { DynamicStrategy::full_table, DynamicStrategy::rolling_row, DynamicStrategy::divide_and_conquer } )
+				{
+					DynamicOptions options;
+					options.kernel = kernel;
+					options.strategy = strategy;
+					TEST_TRUE("same rides as scalar", *expected_small == *dynamic_max_time(*filtered_rides, 500, options));
+					TEST_TRUE("same rides as scalar", *expected_trivial == *dynamic_max_time(trivial_rides, 14, options));
+				}
+			}
+			
+			// Every cost against a row that isn't a whole number of vectors, in place and not
+			std::vector<double> previous(37), expected(37), actual(37);
+			for ( size_t j = 0; j < previous.size(); j++ )
+			{
+				previous[j] = (j * 7919) % 23;
+			}
+			for ( int cost = 1; cost <= 40; cost++ )
+			{
+				for ( auto kernel : { KnapsackKernel::avx2, KnapsackKernel::avx512, KnapsackKernel::neon } )
+				{
+					uint64_t expected_taken = 0, actual_taken = 0;
+					knapsack_row_scalar(previous.data(), expected.data(), &expected_taken, 0, 36, cost, 3.5);
+					knapsack_row_kernel(kernel)(previous.data(), actual.data(), &actual_taken, 0, 36, cost, 3.5);
+					TEST_TRUE("same row", expected == actual);
+					TEST_EQUAL("same decisions", expected_taken, actual_taken);
+					
+					actual = previous;
+					actual_taken = 0;
+					knapsack_row_kernel(kernel)(actual.data(), actual.data(), &actual_taken, 0, 36, cost, 3.5);
+					for ( int j = 0; j < cost && j < 37; j++ )
+					{
+						expected[j] = previous[j];
+					}
+					TEST_TRUE("same row in place", expected == actual);
+					TEST_EQUAL("same decisions in place", expected_taken, actual_taken);
+				}
+			}
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"parallel_dynamic_max_time", 2,
+		[&]()
+		{
+			auto expected = dynamic_max_time(*filtered_rides, 500);
+			for ( size_t threads : { 1, 3, 4 } )
+			{
+				auto actual = parallel_dynamic_max_time(*filtered_rides, 500, threads);
+				TEST_TRUE("non-null", actual);
+				TEST_TRUE("same rides as serial", *expected == *actual);
+				
+				for ( int budget : { 3, 9, 10, 14 } )
+				{
+					TEST_TRUE("same rides as serial", *dynamic_max_time(trivial_rides, budget) == *parallel_dynamic_max_time(trivial_rides, budget, threads));
+				}
+			}
+			
+			DynamicOptions divide;
+			divide.strategy = DynamicStrategy::divide_and_conquer;
+			auto small_rides = filter_ride_vector(*filtered_rides, 1, 2500, 300);
+			TEST_TRUE("divide and conquer in parallel",
+				*dynamic_max_time(*small_rides, 700) == *parallel_dynamic_max_time(*small_rides, 700, 3, divide));
+		}
+	);
+	
 	//
 	rubric.criterion(
 		"exhaustive_max_time trivial cases", 2,
@@ -206,6 +370,1210 @@ int main()
 		}
 	);
 	
+	//
+	rubric.criterion(
+		"exhaustive_max_time Gray code order", 2,
+		[&]()
+		{
+			RideVector twins;
+			twins.push_back(std::shared_ptr<RideItem>(new RideItem("first twin", 5, 10.0)));
+			twins.push_back(std::shared_ptr<RideItem>(new RideItem("second twin", 5, 10.0)));
+			auto soln = exhaustive_max_time(twins, 5);
+			TEST_EQUAL("one twin", 1, soln->size());
+			TEST_EQUAL("ties go to the first subset", "first twin", (*soln)[0]->description());
+			
+			// Against a plain upward enumeration that re-sums every subset
+			auto rides = filter_ride_vector(*filtered_rides, 1, 2000, 12);
+			for ( int budget = 0; budget <= 1000; budget += 37 )
+			{
+				RideVector expected;
+				double expected_time = 0;
+				for ( uint64_t bits = 0; bits < (uint64_t(1) << rides->size()); bits++ )
+				{
+					RideVector candidate;
+					for ( size_t j = 0; j < rides->size(); j++ )
+					{
+						if ( (bits >> j) & 1 )
+						{
+							candidate.push_back((*rides)[j]);
+						}
+					}
+					int cost;
+					double time;
+					sum_ride_vector(candidate, cost, time);
+					if ( cost <= budget && (bits == 0 || time > expected_time) )
+					{
+						expected = candidate;
+						expected_time = time;
+					}
+				}
+				TEST_TRUE("same subset as upward enumeration", expected == *exhaustive_max_time(*rides, budget));
+			}
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"parallel_exhaustive_max_time", 2,
+		[&]()
+		{
+			for ( size_t n : { 0, 1, 5, 14 } )
+			{
+				auto rides = filter_ride_vector(*filtered_rides, 1, 2000, n);
+				for ( size_t threads : { 1, 3, 4 } )
+				{
+					for ( int budget : { 0, 100, 500, 2000 } )
+					{
+						auto actual = parallel_exhaustive_max_time(*rides, budget, threads);
+						TEST_TRUE("non-null", actual);
+						TEST_TRUE("same subset as serial", *exhaustive_max_time(*rides, budget) == *actual);
+					}
+				}
+			}
+			
+			RideVector twins;
+			for ( int i = 0; i < 6; i++ )
+			{
+				twins.push_back(std::shared_ptr<RideItem>(new RideItem("twin", 5, 10.0)));
+			}
+			TEST_TRUE("same tie-break as serial", *exhaustive_max_time(twins, 15) == *parallel_exhaustive_max_time(twins, 15, 4));
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"meet_in_middle_max_time", 2,
+		[&]()
+		{
+			TEST_TRUE("empty solution", meet_in_middle_max_time(trivial_rides, 3)->empty());
+			TEST_EQUAL("Ferris Wheel only", "test Ferris Wheel", (*meet_in_middle_max_time(trivial_rides, 10))[0]->description());
+			TEST_EQUAL("Speedway only", "test Speedway", (*meet_in_middle_max_time(trivial_rides, 9))[0]->description());
+			TEST_EQUAL("Ferris Wheel and Speedway", 2, meet_in_middle_max_time(trivial_rides, 14)->size());
+			TEST_TRUE("negative budget", meet_in_middle_max_time(trivial_rides, -1)->empty());
+			
+			for ( size_t n : { 1, 7, 16, 45 } )
+			{
+				auto rides = filter_ride_vector(*filtered_rides, 1, 2000, n);
+				for ( int budget : { 0, 100, 700, 2000 } )
+				{
+					auto expected = n <= 16 ? exhaustive_max_time(*rides, budget) : dynamic_max_time(*rides, budget);
+					auto actual = meet_in_middle_max_time(*rides, budget);
+					TEST_TRUE("non-null", actual);
+					
+					int expected_cost, actual_cost;
+					double expected_time, actual_time;
+					sum_ride_vector(*expected, expected_cost, expected_time);
+					sum_ride_vector(*actual, actual_cost, actual_time);
+					TEST_LE("within budget", actual_cost, budget);
+					TEST_TRUE("optimal time", std::fabs(expected_time - actual_time) < 1e-6);
+				}
+			}
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"branch_and_bound_max_time", 2,
+		[&]()
+		{
+			TEST_TRUE("empty solution", branch_and_bound_max_time(trivial_rides, 3)->empty());
+			TEST_EQUAL("Ferris Wheel only", "test Ferris Wheel", (*branch_and_bound_max_time(trivial_rides, 10))[0]->description());
+			TEST_EQUAL("Speedway only", "test Speedway", (*branch_and_bound_max_time(trivial_rides, 9))[0]->description());
+			TEST_EQUAL("Ferris Wheel and Speedway", 2, branch_and_bound_max_time(trivial_rides, 14)->size());
+			
+			for ( int budget : { 100, 500 } )
+			{
+				BranchAndBoundStats stats;
+				auto soln = branch_and_bound_max_time(*filtered_rides, budget, BranchAndBoundOptions(), stats);
+				int expected_cost, actual_cost;
+				double expected_time, actual_time;
+				sum_ride_vector(*dynamic_max_time(*filtered_rides, budget), expected_cost, expected_time);
+				sum_ride_vector(*soln, actual_cost, actual_time);
+				TEST_LE("within budget", actual_cost, budget);
+				TEST_TRUE("optimal time", std::fabs(expected_time - actual_time) < 1e-6);
+				TEST_TRUE("proven optimal", stats.optimal);
+				TEST_EQUAL("no gap", 0.0, stats.gap);
+			}
+			
+			BranchAndBoundOptions limited;
+			limited.node_limit = 50;
+			BranchAndBoundStats stats;
+			auto soln = branch_and_bound_max_time(*filtered_rides, 5000, limited, stats);
+			int cost;
+			double time;
+			sum_ride_vector(*soln, cost, time);
+			TEST_FALSE("stopped at the node limit", stats.optimal);
+			TEST_LE("node limit", stats.nodes, 50);
+			TEST_LE("within budget", cost, 5000);
+			TEST_EQUAL("best so far", stats.best_time, time);
+			TEST_GE("upper bound covers the optimum", stats.upper_bound, 82766.44);
+			TEST_GT("gap", stats.gap, 0);
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"dynamic_max_time divides costs by their GCD", 1,
+		[&]()
+		{
+			RideVector scaled;
+			for ( auto& ride : trivial_rides )
+			{
+				scaled.push_back(std::shared_ptr<RideItem>(new RideItem(ride->description(), ride->cost() * 3, ride->time())));
+			}
+			TEST_EQUAL("GCD", 6, ride_cost_gcd(scaled));
+			for ( int budget : { 3, 9, 10, 14 } )
+			{
+				auto expected = dynamic_max_time(trivial_rides, budget);
+				for ( int extra : { 0, 1, 2 } )
+				{
+					auto actual = dynamic_max_time(scaled, budget * 3 + extra);
+					TEST_EQUAL("same rides", expected->size(), actual->size());
+					for ( size_t i = 0; i < expected->size(); i++ )
+					{
+						TEST_EQUAL("same rides", (*expected)[i]->description(), (*actual)[i]->description());
+					}
+				}
+			}
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"solve_max_time", 2,
+		[&]()
+		{
+			SolveReport report;
+			auto soln = solve_max_time(trivial_rides, 14, SolveOptions(), report);
+			TEST_EQUAL("tiny inputs go exhaustive", "exhaustive", std::string(solver_engine_name(report.engine)));
+			TEST_EQUAL("Ferris Wheel and Speedway", 2, soln->size());
+			TEST_EQUAL("every engine estimated", 4, report.estimates.size());
+			
+			soln = solve_max_time(*filtered_rides, 500, SolveOptions(), report);
+			TEST_EQUAL("large catalogs go dynamic", "dynamic", std::string(solver_engine_name(report.engine)));
+			TEST_TRUE("same rides as dynamic_max_time", *soln == *dynamic_max_time(*filtered_rides, 500));
+			TEST_GT("predicted runtime", report.predicted_seconds, 0);
+			TEST_GE("actual runtime", report.actual_seconds, 0);
+			
+			// A budget far too wide for the DP, over few enough rides to meet in the middle
+			auto rides = filter_ride_vector(*filtered_rides, 1, 2000, 30);
+			SolveOptions tight;
+			tight.memory_limit_bytes = 16 << 20;
+			soln = solve_max_time(*rides, 100000000, tight, report);
+			TEST_EQUAL("huge budgets go meet in the middle", "meet_in_middle", std::string(solver_engine_name(report.engine)));
+			TEST_EQUAL("everything fits", rides->size(), soln->size());
+			
+			int cost;
+			double time;
+			
+			// Nothing exact fits in a few kilobytes
+			tight.memory_limit_bytes = 4096;
+			tight.time_limit_seconds = 0.5;
+			soln = solve_max_time(*filtered_rides, 500, tight, report);
+			TEST_EQUAL("fallback", "branch_and_bound", std::string(solver_engine_name(report.engine)));
+			sum_ride_vector(*soln, cost, time);
+			TEST_LE("within budget", cost, 500);
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"load_mapped_ride_database", 2,
+		[&]()
+		{
+			auto database = load_mapped_ride_database("ride.csv");
+			TEST_TRUE("non-null", database);
+			TEST_EQUAL("size", all_rides->size(), database->records().size());
+			for ( size_t i = 0; i < all_rides->size(); i += 997 )
+			{
+				TEST_EQUAL("description", (*all_rides)[i]->description(), database->records()[i].description);
+				TEST_EQUAL("cost", (*all_rides)[i]->cost(), database->records()[i].cost);
+				TEST_EQUAL("time", (*all_rides)[i]->time(), database->records()[i].time);
+			}
+			TEST_TRUE("descriptions point into the file",
+				database->records()[0].description.data() >= database->file().data()
+				&& database->records()[0].description.data() < database->file().data() + database->file().size());
+			
+			const char* path = "maxtime_test_rides.csv";
+			{
+				std::ofstream f(path);
+				f << "Item^Cost^Time\n"
+					<< "good ride^12^30.5\r\n"
+					<< "^5^10\n"
+					<< "free ride^0^10\n"
+					<< "bad number^x^10\n"
+					<< "not a number^5^nan\n"
+					<< "forever^5^inf\n"
+					<< "trailing separator^7^2.25^\n"
+					<< "no newline^3^1";
+			}
+			database = load_mapped_ride_database(path);
+			TEST_TRUE("non-null", database);
+			TEST_EQUAL("valid rows", 3, database->records().size());
+			TEST_EQUAL("skipped rows", 5, database->skipped());
+			TEST_EQUAL("description", "good ride", database->records()[0].description);
+			TEST_EQUAL("time", 30.5, database->records()[0].time);
+			TEST_EQUAL("trailing separator", 2.25, database->records()[1].time);
+			TEST_EQUAL("no newline", 3, database->records()[2].cost);
+			
+			{
+				std::ofstream f(path);
+				f << "Item^Cost^Time\n" << "a^5^nan\n" << "b^1^infinity\n" << "d^2^10\n" << "e^3^4\n";
+			}
+			auto finite = load_ride_database(path);
+			TEST_EQUAL("non-finite times skipped", 2, finite->size());
+			int exhaustive_cost, dynamic_cost;
+			double exhaustive_time, dynamic_time;
+			sum_ride_vector(*exhaustive_max_time(*finite, 10), exhaustive_cost, exhaustive_time);
+			sum_ride_vector(*dynamic_max_time(*finite, 10), dynamic_cost, dynamic_time);
+			TEST_EQUAL("exhaustive plan", 14.0, exhaustive_time);
+			TEST_EQUAL("dynamic plan", 14.0, dynamic_time);
+			
+			{
+				std::ofstream f(path);
+				f << "Item^Cost^Time\n" << "good ride^12^30.5\n" << "two^fields\n";
+			}
+			TEST_FALSE("wrong field count", load_mapped_ride_database(path));
+			TEST_FALSE("wrong field count", load_ride_database(path));
+			std::remove(path);
+			
+			TEST_FALSE("missing file", load_mapped_ride_database(path));
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"parallel ride database loading", 2,
+		[&]()
+		{
+			auto parallel = load_ride_database("ride.csv", 4);
+			TEST_TRUE("non-null", parallel);
+			TEST_EQUAL("size", all_rides->size(), parallel->size());
+			for ( size_t i = 0; i < all_rides->size(); i++ )
+			{
+				TEST_EQUAL("file order", (*all_rides)[i]->description(), (*parallel)[i]->description());
+			}
+			
+			std::string text;
+			for ( int line = 2; line < 30000; line++ )
+			{
+				if ( line % 4999 == 0 )
+				{
+					text += "skipped ride^0^1\n";
+				}
+				else
+				{
+					text += "ride number " + std::to_string(line) + "^" + std::to_string(1 + line % 90) + "^12.5\n";
+				}
+			}
+			RideParseResult serial_result, parallel_result;
+			TEST_TRUE("parses", parse_ride_lines(text, 2, serial_result));
+			TEST_TRUE("parses", parallel_parse_ride_lines(text, 2, shared_thread_pool(4), parallel_result));
+			TEST_EQUAL("lines", serial_result.lines, parallel_result.lines);
+			TEST_EQUAL("rows", serial_result.records.size(), parallel_result.records.size());
+			for ( size_t i = 0; i < serial_result.records.size(); i++ )
+			{
+				TEST_EQUAL("row order", serial_result.records[i].description, parallel_result.records[i].description);
+			}
+			TEST_EQUAL("skipped", 6, parallel_result.skipped_lines.size());
+			TEST_TRUE("skipped line numbers", serial_result.skipped_lines == parallel_result.skipped_lines);
+			TEST_EQUAL("skipped line numbers", 29994, parallel_result.skipped_lines.back());
+			
+			text.insert(text.find("ride number 23456^"), "no fields\n");
+			RideParseResult serial_error, parallel_error;
+			TEST_FALSE("malformed", parse_ride_lines(text, 2, serial_error));
+			TEST_FALSE("malformed", parallel_parse_ride_lines(text, 2, shared_thread_pool(4), parallel_error));
+			TEST_EQUAL("error line", 23456, serial_error.error_line);
+			TEST_EQUAL("error line", 23456, parallel_error.error_line);
+			TEST_EQUAL("error text", "no fields", parallel_error.error_text);
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"ride snapshots", 2,
+		[&]()
+		{
+			const char* path = "maxtime_test_rides.csv";
+			std::string snapshot_path = ride_snapshot_path(path);
+			{
+				std::ofstream f(path);
+				f << "Item^Cost^Time\n" << "csv ride^12^30.5\n";
+			}
+			
+			TEST_TRUE("write", write_ride_snapshot(*filtered_rides, snapshot_path, path));
+			auto snapshot = open_ride_snapshot(snapshot_path);
+			TEST_TRUE("open", snapshot);
+			TEST_TRUE("fresh", snapshot->is_fresh(path));
+			TEST_EQUAL("size", filtered_rides->size(), snapshot->size());
+			for ( size_t i = 0; i < filtered_rides->size(); i += 1009 )
+			{
+				TEST_EQUAL("description", (*filtered_rides)[i]->description(), snapshot->description(i));
+				TEST_EQUAL("cost", (*filtered_rides)[i]->cost(), snapshot->costs()[i]);
+				TEST_EQUAL("time", (*filtered_rides)[i]->time(), snapshot->times()[i]);
+			}
+			
+			// The snapshot, not the CSV, while it is up to date
+			auto loaded = load_ride_database(path);
+			TEST_EQUAL("loaded from the snapshot", filtered_rides->size(), loaded->size());
+			TEST_EQUAL("loaded from the snapshot", (*filtered_rides)[0]->description(), (*loaded)[0]->description());
+			
+			{
+				std::ofstream f(path, std::ios::app);
+				f << "another csv ride^7^10\n";
+			}
+			TEST_FALSE("stale", open_ride_snapshot(snapshot_path)->is_fresh(path));
+			loaded = load_ride_database(path);
+			TEST_EQUAL("stale snapshot falls back to the CSV", 2, loaded->size());
+			TEST_EQUAL("stale snapshot falls back to the CSV", "csv ride", (*loaded)[0]->description());
+			
+			{
+				std::ofstream f(snapshot_path, std::ios::binary | std::ios::trunc);
+				f << "not a snapshot";
+			}
+			TEST_FALSE("invalid", open_ride_snapshot(snapshot_path));
+			TEST_EQUAL("invalid snapshot falls back to the CSV", 2, load_ride_database(path)->size());
+			
+			// A valid snapshot with one field of its header or offset table corrupted
+			RideVector few(filtered_rides->begin(), filtered_rides->begin() + 4);
+			TEST_TRUE("written", write_ride_snapshot(few, snapshot_path, path));
+			TEST_TRUE("valid", open_ride_snapshot(snapshot_path));
+			std::string bytes;
+			{
+				std::ifstream f(snapshot_path, std::ios::binary);
+				bytes.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+			}
+			RideSnapshotHeader header;
+			std::memcpy(&header, bytes.data(), sizeof(header));
+			auto corrupted = [&](size_t at, uint64_t value)
+			{
+				std::string copy = bytes;
+				std::memcpy(&copy[at], &value, sizeof(value));
+				std::ofstream f(snapshot_path, std::ios::binary | std::ios::trunc);
+				f << copy;
+				f.close();
+				return !open_ride_snapshot(snapshot_path);
+			};
+			size_t offsets_at = header.description_offsets_offset;
+			TEST_TRUE("offset past the pool", corrupted(offsets_at + 2 * sizeof(uint64_t), header.pool_size + 100));
+			TEST_TRUE("offsets out of order", corrupted(offsets_at + 2 * sizeof(uint64_t), 1));
+			TEST_TRUE("empty description", corrupted(offsets_at + 1 * sizeof(uint64_t), 0));
+			TEST_TRUE("overflowing count", corrupted(offsetof(RideSnapshotHeader, count), uint64_t(1) << 62));
+			TEST_TRUE("offset near the top", corrupted(offsetof(RideSnapshotHeader, times_offset), UINT64_MAX - 7));
+			uint64_t nan_bits, infinity_bits;
+			double nan = std::numeric_limits<double>::quiet_NaN(), infinity = std::numeric_limits<double>::infinity();
+			std::memcpy(&nan_bits, &nan, sizeof(nan));
+			std::memcpy(&infinity_bits, &infinity, sizeof(infinity));
+			TEST_TRUE("nan time", corrupted(header.times_offset + sizeof(double), nan_bits));
+			TEST_TRUE("infinite time", corrupted(header.times_offset, infinity_bits));
+			TEST_FALSE("uncorrupted", corrupted(offsets_at, 0));
+			
+			std::remove(snapshot_path.c_str());
+			std::remove(path);
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"RideTable", 2,
+		[&]()
+		{
+			RideTable table(*all_rides);
+			TEST_EQUAL("size", all_rides->size(), table.size());
+			TEST_TRUE("descriptions interned", table.description_count() <= table.size());
+			TEST_EQUAL("description", (*all_rides)[123]->description(), table.description(123));
+			
+			for (int limit : { 0, 3, 10, 1000 })
+			{
+				auto rides = filter_ride_vector(*all_rides, 100, 500, limit);
+				RideIndexList rows = filter_ride_vector(table, 100, 500, limit);
+				TEST_EQUAL("filter size", rides->size(), rows.size());
+				for (size_t i = 0; i < rows.size(); i++)
+				{
+					TEST_EQUAL("filter rows", (*rides)[i]->description(), table.description(rows[i]));
+				}
+			}
+			
+			RideIndexList rows = filter_ride_vector(table, 1, 2500, 40);
+			auto rides = filter_ride_vector(*all_rides, 1, 2500, 40);
+			for (int budget : { 0, 37, 500, 2000 })
+			{
+				auto expected = dynamic_max_time(*rides, budget);
+				RideIndexList chosen = dynamic_max_time(table, rows, budget);
+				TEST_EQUAL("dynamic size", expected->size(), chosen.size());
+				for (size_t i = 0; i < chosen.size(); i++)
+				{
+					TEST_EQUAL("dynamic rows", (*expected)[i]->description(), table.description(chosen[i]));
+				}
+				
+				int expected_cost, cost;
+				double expected_time, time;
+				sum_ride_vector(*expected, expected_cost, expected_time);
+				sum_ride_vector(table, chosen, cost, time);
+				TEST_EQUAL("sum cost", expected_cost, cost);
+				TEST_EQUAL("sum time", expected_time, time);
+			}
+			
+			RideIndexList small = filter_ride_vector(table, 1, 2500, 16);
+			auto small_rides = filter_ride_vector(*all_rides, 1, 2500, 16);
+			auto expected = exhaustive_max_time(*small_rides, 300);
+			RideIndexList chosen = exhaustive_max_time(table, small, 300);
+			TEST_EQUAL("exhaustive size", expected->size(), chosen.size());
+			for (size_t i = 0; i < chosen.size(); i++)
+			{
+				TEST_EQUAL("exhaustive rows", (*expected)[i]->description(), table.description(chosen[i]));
+			}
+			
+			auto selected = table.select(chosen);
+			TEST_EQUAL("select", expected->size(), selected->size());
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"RideCatalog and QueryArena", 2,
+		[&]()
+		{
+			// Every loaded ride shares the one control block of its catalog
+			TEST_TRUE("shared control block", (*all_rides)[0].use_count() >= long(all_rides->size()));
+			TEST_EQUAL("shared control block", (*all_rides)[0].use_count(), all_rides->back().use_count());
+			
+			std::shared_ptr<RideCatalog> catalog = make_ride_catalog(2);
+			catalog->emplace(1, "second", 4, 5);
+			catalog->emplace(0, "first", 10, 20);
+			std::shared_ptr<RideItem> kept = (*catalog->rides())[1];
+			catalog.reset();
+			TEST_EQUAL("outlives the catalog pointer", "second", kept->description());
+			
+			RideTable table(*all_rides);
+			RideIndexList rows = filter_ride_vector(table, 1, 2500, 40);
+			QueryArena arena(1024);
+			int previous = -1;
+			for (int budget : { 500, 2000, 2000 })
+			{
+				RideIndexList expected = dynamic_max_time(table, rows, budget);
+				{
+					RideIndexList chosen = dynamic_max_time(table, rows, budget, arena);
+					TEST_TRUE("from the arena", chosen.get_allocator().resource() == arena.resource());
+					TEST_TRUE("same rides", std::equal(expected.begin(), expected.end(), chosen.begin(), chosen.end()));
+				}
+				if (budget == previous)
+				{
+					TEST_EQUAL("repeat query fits in the buffer", 0, arena.overflow_bytes());
+				}
+				previous = budget;
+				arena.reset();
+			}
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"RideFilterView", 2,
+		[&]()
+		{
+			auto same = [&](const RideVector& expected, const RideVector& actual)
+			{
+				TEST_EQUAL("size", expected.size(), actual.size());
+				for (size_t i = 0; i < std::min(expected.size(), actual.size()); i++)
+				{
+					TEST_TRUE("same ride", expected[i] == actual[i]);
+				}
+			};
+			
+			for (int limit : { -1, 0, 3, 10, 100000 })
+			{
+				auto eager = filter_ride_vector(*all_rides, 100, 500, limit);
+				same(*eager, *filter_ride_view(*all_rides, 100, 500, limit).materialize());
+				
+				auto twice = filter_ride_vector(*eager, 200, 300, 5);
+				same(*twice, *filter_ride_view(*all_rides, 100, 500, limit).filter(200, 300, 5).materialize());
+				
+				auto reversed = filter_ride_vector(*filter_ride_vector(*all_rides, 200, 300, 5), 100, 500, limit);
+				same(*reversed, *filter_ride_view(*all_rides, 200, 300, 5).filter(100, 500, limit).materialize());
+			}
+			
+			RideFilterView view = RideFilterView(*all_rides).filter(1, 2500, 500).filter(10, 2000, 40);
+			auto rides = view.materialize();
+			TEST_EQUAL("size", 40, view.size());
+			for (int budget : { 0, 700, 3000 })
+			{
+				same(*dynamic_max_time(*rides, budget), *dynamic_max_time(view, budget));
+			}
+			
+			RideFilterView small = view.filter(1, 2500, 14);
+			same(*exhaustive_max_time(*small.materialize(), 400), *exhaustive_max_time(small, 400));
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"RideTableIndex", 2,
+		[&]()
+		{
+			RideTable table(*all_rides);
+			RideTableIndex index(table);
+			
+			for (double low : { -5.0, 0.0, 1.0, 100.0, 499.5 })
+			{
+				for (double high : { 0.0, 120.0, 500.0, 2500.0 })
+				{
+					for (int limit : { -1, 0, 1, 10, 1000, 100000 })
+					{
+						RideIndexList scanned = filter_ride_vector(table, low, high, limit);
+						RideIndexList indexed = filter_ride_vector(index, low, high, limit);
+						TEST_TRUE("same rows", std::equal(scanned.begin(), scanned.end(), indexed.begin(), indexed.end()));
+					}
+				}
+			}
+			
+			size_t affordable = 0;
+			for (size_t i = 0; i < table.size(); i++)
+			{
+				affordable += table.cost(i) <= 20;
+			}
+			RideIndexList cheap = index.affordable(20);
+			TEST_EQUAL("affordable", affordable, cheap.size());
+			TEST_TRUE("table order", std::is_sorted(cheap.begin(), cheap.end()));
+			TEST_EQUAL("count", affordable, index.cost().count(0, 20));
+			TEST_EQUAL("first k", 5, index.affordable(20, 5).size());
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"dynamic_max_time_batch", 2,
+		[&]()
+		{
+			auto rides = filter_ride_vector(*all_rides, 1, 2500, 60);
+			std::vector<int> budgets = { 500, -1, 0, 37, 2000, 1230, 2000, 7 };
+			
+			DynamicOptions divide;
+			divide.divide_and_conquer_cells = 1000;
+			for (const DynamicOptions& options : { DynamicOptions(), divide })
+			{
+				auto results = dynamic_max_time_batch(*rides, budgets, options);
+				TEST_EQUAL("count", budgets.size(), results.size());
+				for (size_t b = 0; b < budgets.size(); b++)
+				{
+					auto expected = dynamic_max_time(*rides, budgets[b]);
+					TEST_EQUAL("size", expected->size(), results[b]->size());
+					for (size_t i = 0; i < std::min(expected->size(), results[b]->size()); i++)
+					{
+						TEST_TRUE("same rides", (*expected)[i] == (*results[b])[i]);
+					}
+				}
+			}
+			
+			std::vector<size_t> order;
+			dynamic_max_time_batch(*rides, budgets, [&](size_t b, std::unique_ptr<RideVector>) { order.push_back(b); });
+			TEST_EQUAL("streamed in order", budgets.size(), order.size());
+			TEST_TRUE("streamed in order", std::is_sorted(order.begin(), order.end()));
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"IncrementalDynamicSolver", 2,
+		[&]()
+		{
+			auto rides = filter_ride_vector(*all_rides, 1, 2500, 120);
+			IncrementalDynamicSolver solver(1500, 16);
+			auto check = [&](const char* message)
+			{
+				for (int budget : { 0, 99, 800, 1500, 1600 })
+				{
+					auto expected = dynamic_max_time(solver.rides(), budget);
+					auto actual = solver.solve(budget);
+					TEST_EQUAL(message, expected->size(), actual->size());
+					for (size_t i = 0; i < std::min(expected->size(), actual->size()); i++)
+					{
+						TEST_TRUE(message, (*expected)[i] == (*actual)[i]);
+					}
+				}
+			};
+			
+			for (size_t i = 0; i < 100; i++)
+			{
+				solver.append((*rides)[i]);
+			}
+			TEST_EQUAL("one row per append", 100, solver.rows_computed());
+			check("appended");
+			
+			solver.append((*rides)[100]);
+			TEST_EQUAL("one row per append", 101, solver.rows_computed());
+			check("appended again");
+			
+			size_t before = solver.rows_computed();
+			solver.remove(90);
+			solver.remove(95);
+			check("removed near the end");
+			TEST_EQUAL("rows from the checkpoint", before + (99 - 80), solver.rows_computed());
+			
+			solver.remove(3);
+			solver.append((*rides)[110]);
+			check("removed near the start, then appended");
+			
+			solver.remove(solver.size() - 1);
+			solver.append((*rides)[111]);
+			check("removed the last, then appended");
+			
+			while (solver.size() > 0)
+			{
+				solver.remove(solver.size() - 1);
+			}
+			check("empty");
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"preprocessed_dynamic_max_time", 2,
+		[&]()
+		{
+			RideVector rides(all_rides->begin(), all_rides->begin() + 150);
+			rides.push_back(std::shared_ptr<RideItem>(new RideItem("zero time", 3, 0)));
+			rides.push_back(std::shared_ptr<RideItem>(new RideItem("same as the first", rides[0]->cost(), rides[0]->time())));
+			
+			PreprocessOptions dominated;
+			dominated.prune_dominated = true;
+			for (int budget : { 0, 25, 300, 1500 })
+			{
+				auto expected = dynamic_max_time(rides, budget);
+				int expected_cost;
+				double expected_time;
+				sum_ride_vector(*expected, expected_cost, expected_time);
+				
+				PreprocessStats stats;
+				auto exact = preprocessed_dynamic_max_time(rides, budget, PreprocessOptions(), stats);
+				TEST_EQUAL("zero time dropped", 1, stats.no_time);
+				TEST_EQUAL("same size", expected->size(), exact->size());
+				for (size_t i = 0; i < std::min(expected->size(), exact->size()); i++)
+				{
+					TEST_TRUE("same rides", (*expected)[i] == (*exact)[i]);
+				}
+				
+				auto pruned = preprocessed_dynamic_max_time(rides, budget, dominated, stats);
+				int cost;
+				double time;
+				sum_ride_vector(*pruned, cost, time);
+				TEST_TRUE("within budget", cost <= budget);
+				TEST_TRUE("same time", std::fabs(time - expected_time) < 1e-9);
+				if (budget == 25)
+				{
+					TEST_TRUE("dominated rides dropped", stats.dominated > 0);
+				}
+			}
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"bounded_dynamic_max_time", 2,
+		[&]()
+		{
+			RideVector rides(filtered_rides->begin(), filtered_rides->begin() + 12);
+			std::vector<int> ones(rides.size(), 1), counts(rides.size());
+			RideVector expanded;
+			for (size_t i = 0; i < rides.size(); i++)
+			{
+				counts[i] = int(i % 5);
+				expanded.insert(expanded.end(), counts[i], rides[i]);
+			}
+			
+			for (int budget : { 0, 40, 333, 1500 })
+			{
+				auto single = bounded_dynamic_max_time(rides, ones, budget);
+				auto expected_single = dynamic_max_time(rides, budget);
+				TEST_EQUAL("counts of one", expected_single->size(), single->size());
+				for (size_t i = 0; i < std::min(single->size(), expected_single->size()); i++)
+				{
+					TEST_TRUE("counts of one", (*single)[i] == (*expected_single)[i]);
+				}
+				
+				auto bounded = bounded_dynamic_max_time(rides, counts, budget);
+				int cost, expected_cost;
+				double time, expected_time;
+				sum_ride_vector(*bounded, cost, time);
+				sum_ride_vector(*dynamic_max_time(expanded, budget), expected_cost, expected_time);
+				TEST_TRUE("within budget", cost <= budget);
+				TEST_TRUE("same time as duplicated rides", std::fabs(time - expected_time) < 1e-6);
+				for (size_t i = 0; i < rides.size(); i++)
+				{
+					TEST_TRUE("within count", std::count(bounded->begin(), bounded->end(), rides[i]) <= counts[i]);
+				}
+			}
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"greedy_max_time and fptas_max_time", 2,
+		[&]()
+		{
+			for (int budget : { 0, 9, 150, 1000 })
+			{
+				auto exact = dynamic_max_time(*all_rides, budget);
+				int optimum_cost;
+				double optimum;
+				sum_ride_vector(*exact, optimum_cost, optimum);
+				
+				for (double epsilon : { 0.5, 0.25, 0.05 })
+				{
+					ApproximateStats stats;
+					auto approximate = approximate_max_time(*all_rides, budget, epsilon, stats);
+					int cost;
+					double time;
+					sum_ride_vector(*approximate, cost, time);
+					TEST_TRUE("within budget", cost <= budget);
+					TEST_EQUAL("reported time", time, stats.time);
+					TEST_TRUE("ratio", stats.ratio >= 1 - epsilon);
+					TEST_TRUE("guarantee", time >= stats.ratio * optimum - 1e-9);
+					TEST_TRUE("upper bound", optimum <= stats.upper_bound + 1e-9);
+					TEST_TRUE("ride order", std::is_sorted(approximate->begin(), approximate->end(),
+						[&](const std::shared_ptr<RideItem>& a, const std::shared_ptr<RideItem>& b)
+						{
+							return std::find(all_rides->begin(), all_rides->end(), a) < std::find(all_rides->begin(), all_rides->end(), b);
+						}));
+				}
+			}
+			
+			// The greedy prefix alone would take the cheap ride and miss the long one
+			RideVector rides;
+			rides.push_back(std::shared_ptr<RideItem>(new RideItem("cheap", 1, 2)));
+			rides.push_back(std::shared_ptr<RideItem>(new RideItem("long", 100, 100)));
+			auto greedy = greedy_max_time(rides, 100);
+			TEST_EQUAL("best single ride", 1, greedy->size());
+			TEST_EQUAL("best single ride", "long", (*greedy)[0]->description());
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"cancellable dynamic and exhaustive", 2,
+		[&]()
+		{
+			AnytimeStats stats;
+			{
+				CancellationToken unlimited;
+				auto expected = dynamic_max_time(*filtered_rides, 300);
+				auto plan = dynamic_max_time(*filtered_rides, 300, unlimited, stats);
+				TEST_TRUE("complete", stats.complete);
+				TEST_EQUAL("same plan", expected->size(), plan->size());
+				for (size_t i = 0; i < std::min(expected->size(), plan->size()); i++)
+				{
+					TEST_TRUE("same plan", (*expected)[i] == (*plan)[i]);
+				}
+			}
+			
+			DynamicOptions divide;
+			divide.divide_and_conquer_cells = 1000;
+			for (const DynamicOptions& options : { DynamicOptions(), divide })
+			{
+				CancellationToken cancelled;
+				cancelled.cancel();
+				auto plan = dynamic_max_time(*filtered_rides, 300, cancelled, stats, options);
+				int cost;
+				double time;
+				sum_ride_vector(*plan, cost, time);
+				TEST_FALSE("stopped", stats.complete);
+				TEST_EQUAL("no rows", 0.0, stats.progress);
+				TEST_TRUE("feasible", cost <= 300);
+				TEST_TRUE("a plan", time > 0);
+			}
+			
+			{
+				// Stopped by its first forward pass, the recursion must not go on to its other nodes
+				DynamicProblem problem = dynamic_problem(*filtered_rides, 300);
+				bool stopped = false;
+				size_t passes = 0;
+				auto chosen = dynamic_divide_and_conquer(
+					problem,
+					[&](DynamicRow&, size_t, size_t, int)
+					{
+						passes++;
+						stopped = true;
+					},
+					&stopped
+				);
+				TEST_EQUAL("divide and conquer stops at once", 1, passes);
+				TEST_TRUE("nothing decided", chosen.empty());
+			}
+			
+			for (const DynamicOptions& options : { DynamicOptions(), divide })
+			{
+				// Stopped partway through the rows: the deadline doubles until one falls inside them
+				ApproximateStats greedy;
+				greedy_max_time(*filtered_rides, 2000, greedy);
+				bool partway = false;
+				for (double seconds = 1e-4; !partway && seconds < 60; seconds *= 2)
+				{
+					CancellationToken deadline(seconds);
+					auto plan = dynamic_max_time(*filtered_rides, 2000, deadline, stats, options);
+					if (stats.complete)
+					{
+						break;
+					}
+					int cost;
+					double time;
+					sum_ride_vector(*plan, cost, time);
+					TEST_TRUE("progress", stats.progress < 1);
+					TEST_TRUE("feasible", cost <= 2000);
+					TEST_TRUE("at least greedy", time >= greedy.time);
+					partway = stats.progress > 0;
+				}
+				TEST_TRUE("stopped partway", partway);
+			}
+			
+			{
+				CancellationToken expired(0);
+				auto plan = exhaustive_max_time(*filtered_rides, 300, expired, stats);
+				int cost;
+				double time;
+				sum_ride_vector(*plan, cost, time);
+				TEST_FALSE("stopped", stats.complete);
+				TEST_TRUE("progress", stats.progress < 1e-6);
+				TEST_TRUE("feasible", cost <= 300);
+				TEST_TRUE("a plan", time > 0);
+			}
+			
+			{
+				CancellationToken unlimited;
+				auto small = filter_ride_vector(*all_rides, 1, 2500, 14);
+				auto plan = exhaustive_max_time(*small, 300, unlimited, stats);
+				auto expected = exhaustive_max_time(*small, 300);
+				TEST_TRUE("complete", stats.complete);
+				TEST_TRUE("same plan", *plan == *expected);
+			}
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"MaxTimeService", 2,
+		[&]()
+		{
+			auto rides = std::make_shared<const RideVector>(filtered_rides->begin(), filtered_rides->begin() + 60);
+			auto others = std::make_shared<const RideVector>(filtered_rides->begin() + 60, filtered_rides->begin() + 100);
+			std::vector<int> budgets = { 100, 250, -3, 730, 1000, 42 };
+			
+			std::unique_ptr<MaxTimeService> service(new MaxTimeService(2, 4));
+			std::vector<std::future<std::unique_ptr<RideVector>>> plans;
+			std::mutex mutex;
+			std::vector<std::unique_ptr<RideVector>> called(budgets.size());
+			for (size_t b = 0; b < budgets.size(); b++)
+			{
+				plans.push_back(service->submit(rides, budgets[b]));
+				service->submit(others, budgets[b], [&, b](std::unique_ptr<RideVector> chosen)
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					called[b] = std::move(chosen);
+				});
+			}
+			
+			for (size_t b = 0; b < budgets.size(); b++)
+			{
+				auto plan = plans[b].get();
+				auto expected = dynamic_max_time(*rides, budgets[b]);
+				TEST_TRUE("future", plan && *plan == *expected);
+			}
+			
+			// The destructor answers everything still queued
+			MaxTimeServiceStats stats = service->stats();
+			TEST_TRUE("coalesced", stats.batches <= stats.requests);
+			service.reset();
+			for (size_t b = 0; b < budgets.size(); b++)
+			{
+				auto expected = dynamic_max_time(*others, budgets[b]);
+				TEST_TRUE("callback", called[b] && *called[b] == *expected);
+			}
+			
+			{
+				BoundedQueue<int> queue(2);
+				TEST_TRUE("room", queue.try_push(1));
+				TEST_TRUE("room", queue.try_push(2));
+				TEST_FALSE("full", queue.try_push(3));
+				int item;
+				TEST_TRUE("pop", queue.pop(item));
+				TEST_EQUAL("fifo", 1, item);
+				queue.close();
+				TEST_FALSE("closed", queue.push(4));
+				TEST_TRUE("drain", queue.try_pop(item));
+				TEST_EQUAL("fifo", 2, item);
+				TEST_FALSE("drained", queue.pop(item));
+			}
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"MaxTimeCache", 2,
+		[&]()
+		{
+			RideVector rides(filtered_rides->begin(), filtered_rides->begin() + 50);
+			RideVector copy;
+			for (auto& ride : rides)
+			{
+				copy.push_back(std::shared_ptr<RideItem>(new RideItem("copy of " + ride->description(), ride->cost(), ride->time())));
+			}
+			TEST_EQUAL("fingerprint of equal rides", ride_fingerprint(rides), ride_fingerprint(copy));
+			RideVector fewer(rides.begin(), rides.end() - 1);
+			TEST_TRUE("fingerprint of other rides", ride_fingerprint(rides) != ride_fingerprint(fewer));
+			
+			MaxTimeCache cache;
+			auto plan = cache.dynamic_max_time(rides, 400);
+			TEST_TRUE("solved", *plan == *dynamic_max_time(rides, 400));
+			plan = cache.dynamic_max_time(rides, 400);
+			TEST_TRUE("remembered", *plan == *dynamic_max_time(rides, 400));
+			plan = cache.dynamic_max_time(copy, 400);
+			TEST_TRUE("the caller's rides", *plan == *dynamic_max_time(copy, 400));
+			
+			RideVector small(rides.begin(), rides.begin() + 12);
+			cache.exhaustive_max_time(small, 400);
+			TEST_TRUE("exhaustive", *cache.exhaustive_max_time(small, 400) == *exhaustive_max_time(small, 400));
+			
+			MaxTimeCacheStats stats = cache.stats();
+			TEST_EQUAL("hits", 3, stats.hits);
+			TEST_EQUAL("misses", 2, stats.misses);
+			TEST_EQUAL("entries", 2, stats.entries);
+			
+			// Room for about two answers
+			size_t limit = stats.bytes;
+			MaxTimeCache tiny(limit);
+			for (int budget = 100; budget < 120; budget++)
+			{
+				tiny.dynamic_max_time(rides, budget);
+			}
+			stats = tiny.stats();
+			TEST_TRUE("memory limit", stats.bytes <= limit);
+			TEST_TRUE("evicted", stats.evictions > 0);
+			tiny.dynamic_max_time(rides, 119);
+			TEST_EQUAL("most recent kept", 1, tiny.stats().hits);
+			tiny.dynamic_max_time(rides, 100);
+			TEST_EQUAL("least recent evicted", 21, tiny.stats().misses);
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"dynamic_max_time_fixed", 2,
+		[&]()
+		{
+			RideVector rides(filtered_rides->begin(), filtered_rides->begin() + 80);
+			rides.push_back(std::shared_ptr<RideItem>(new RideItem("too expensive", 3000, 5000)));
+			for (int budget : { 0, 100, 250, 333, 500, 1000 })
+			{
+				auto expected = dynamic_max_time(rides, budget);
+				auto fixed = dynamic_max_time_fixed(rides, budget);
+				TEST_TRUE("same rides", *fixed == *expected);
+			}
+			TEST_TRUE("trivial", *select_rides(trivial_rides, dynamic_select_fixed<100>(trivial_rides)) == *dynamic_max_time(trivial_rides, 100));
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"fixed_point_dynamic_max_time", 2,
+		[&]()
+		{
+			RideVector rides(filtered_rides->begin(), filtered_rides->begin() + 120);
+			auto centiminute_total = [](const RideVector& chosen)
+			{
+				int64_t total = 0;
+				for (auto& ride : chosen)
+				{
+					total += centiminutes(ride->time());
+				}
+				return total;
+			};
+
+			TEST_EQUAL("rounding", 1234, centiminutes(12.335));
+			TEST_EQUAL("saturation", INT32_MAX, centiminutes(1e12));
+
+			RideTable table(rides);
+			for (int budget : { 0, 75, 300, 1000 })
+			{
+				auto expected = dynamic_max_time(rides, budget);
+				auto fixed = fixed_point_dynamic_max_time(rides, budget);
+				int cost;
+				double time, expected_time;
+				sum_ride_vector(*expected, cost, expected_time);
+				sum_ride_vector(*fixed, cost, time);
+				TEST_TRUE("within budget", cost <= budget);
+				TEST_TRUE("optimal when rounded", centiminute_total(*fixed) >= centiminute_total(*expected));
+				TEST_TRUE("near optimal", time >= expected_time - 0.005 * rides.size());
+
+				for (auto strategy : { DynamicStrategy::full_table, DynamicStrategy::rolling_row })
+				{
+					for (auto kernel : { KnapsackKernel::scalar, KnapsackKernel::avx2, KnapsackKernel::avx512, KnapsackKernel::neon })
+					{
+						DynamicOptions options;
+						options.strategy = strategy;
+						options.kernel = kernel;
+						TEST_TRUE("same rides", *fixed_point_dynamic_max_time(rides, budget, options) == *fixed);
+					}
+				}
+				TEST_TRUE("table", *select_rides(rides, fixed_point_dynamic_max_time(table, table.rows(), budget)) == *fixed);
+			}
+
+			RideVector huge(rides.begin(), rides.begin() + 10);
+			huge.push_back(std::shared_ptr<RideItem>(new RideItem("endless", 1, 3e7)));
+			TEST_TRUE("overflow", *fixed_point_dynamic_max_time(huge, 200) == *dynamic_max_time(huge, 200));
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"QueryStats", 2,
+		[&]()
+		{
+			auto has_phase = [](const QueryStats& stats, const std::string& name)
+			{
+				for (auto& phase : stats.phases)
+				{
+					if (phase.name == name)
+					{
+						return true;
+					}
+				}
+				return false;
+			};
+
+			QueryStats loading;
+			auto loaded = load_ride_database("ride.csv", loading);
+			TEST_EQUAL("load rides", all_rides->size(), loading.rides);
+			TEST_TRUE("load phases", has_phase(loading, "build"));
+
+			QueryStats threaded;
+			auto threaded_rides = load_ride_database("ride.csv", 3, threaded);
+			TEST_EQUAL("threaded load rides", all_rides->size(), threaded.rides);
+			TEST_EQUAL("threaded load phases", loading.phases.size(), threaded.phases.size());
+			for (size_t i = 0; i < std::min(loading.phases.size(), threaded.phases.size()); i++)
+			{
+				TEST_EQUAL("threaded load phase", std::string(loading.phases[i].name), std::string(threaded.phases[i].name));
+			}
+
+			QueryStats filtering;
+			auto rides = filter_ride_vector(*loaded, 1, 2500, 200, filtering);
+			TEST_EQUAL("filter rides", 200, filtering.rides);
+
+			std::vector<QueryStats> queries;
+			for (auto strategy : { DynamicStrategy::full_table, DynamicStrategy::rolling_row, DynamicStrategy::divide_and_conquer })
+			{
+				DynamicOptions options;
+				options.strategy = strategy;
+				QueryStats stats;
+				TEST_TRUE("dynamic rides", *dynamic_max_time(*rides, 300, stats, options) == *dynamic_max_time(*rides, 300, options));
+				TEST_EQUAL("engine", std::string("dynamic/") + dynamic_strategy_name(strategy), stats.engine);
+				TEST_TRUE("cells", stats.cells >= 200 * 301);
+				TEST_TRUE("bytes", stats.peak_bytes > 0 && stats.bytes_allocated >= stats.peak_bytes);
+				TEST_TRUE("phases", has_phase(stats, "select"));
+				TEST_EQUAL("fill phase", strategy != DynamicStrategy::divide_and_conquer, has_phase(stats, "fill"));
+				queries.push_back(stats);
+			}
+
+			RideVector few(rides->begin(), rides->begin() + 12);
+			QueryStats exhaustive;
+			TEST_TRUE("exhaustive rides", *exhaustive_max_time(few, 300, exhaustive) == *exhaustive_max_time(few, 300));
+			TEST_EQUAL("masks", 4096, exhaustive.masks);
+			TEST_TRUE("search phase", has_phase(exhaustive, "search"));
+			queries.push_back(exhaustive);
+
+			std::ostringstream trace;
+			write_chrome_trace(trace, queries);
+			TEST_TRUE("trace", trace.str().find("\"name\":\"dynamic/rolling_row\",\"ph\":\"X\"") != std::string::npos);
+			TEST_TRUE("trace phases", trace.str().find("\"name\":\"search\"") != std::string::npos);
+
+			QueryStats quoted;
+			quoted.engine = "say \"hi\" \\ bye";
+			quoted.phases.push_back({ "tab\there", 0, 0 });
+			std::ostringstream escaped;
+			write_chrome_trace(escaped, { quoted });
+			TEST_TRUE("escaped engine", escaped.str().find("\"name\":\"say \\\"hi\\\" \\\\ bye\"") != std::string::npos);
+			TEST_TRUE("escaped phase", escaped.str().find("\"name\":\"tab\\u0009here\"") != std::string::npos);
+		}
+	);
+	
+	//
+	rubric.criterion(
+		"constrained_max_time", 2,
+		[&]()
+		{
+			RideVector rides(filtered_rides->begin(), filtered_rides->begin() + 14);
+			rides.push_back(std::shared_ptr<RideItem>(new RideItem("half step", 3, 1.5)));
+			auto fits = [](const RideVector& chosen, int budget, double window)
+			{
+				int cost;
+				double time;
+				sum_ride_vector(chosen, cost, time);
+				return cost <= budget && time <= window + 1e-9;
+			};
+			auto total_time = [](const RideVector& chosen)
+			{
+				int cost;
+				double time;
+				sum_ride_vector(chosen, cost, time);
+				return time;
+			};
+
+			for (int budget : { 0, 40, 150, 400 })
+			{
+				for (double window : { 0.0, 30.0, 90.5, 240.0 })
+				{
+					// Every subset, with the step rounding of a 0.5 minute step
+					double best = 0;
+					for (uint32_t mask = 0; mask < (uint32_t(1) << rides.size()); mask++)
+					{
+						int cost = 0, steps = 0;
+						double time = 0;
+						for (size_t i = 0; i < rides.size(); i++)
+						{
+							if ((mask >> i) & 1)
+							{
+								cost += rides[i]->cost();
+								steps += int(std::ceil(rides[i]->time() * 2 - 1e-9));
+								time += rides[i]->time();
+							}
+						}
+						if (cost <= budget && steps <= int(window * 2))
+						{
+							best = std::max(best, time);
+						}
+					}
+
+					ConstrainedOptions options;
+					options.duration_step = 0.5;
+					auto plan = constrained_max_time(rides, budget, window, options);
+					TEST_TRUE("fits", fits(*plan, budget, window));
+					TEST_TRUE("optimal", std::abs(total_time(*plan) - best) < 1e-6);
+
+					ConstrainedOptions split = options;
+					split.divide_and_conquer_cells = 0;
+					TEST_TRUE("divide and conquer", *constrained_max_time(rides, budget, window, split) == *plan);
+					ConstrainedOptions parallel = options;
+					parallel.threads = 3;
+					TEST_TRUE("parallel", *constrained_max_time(rides, budget, window, parallel) == *plan);
+					parallel.divide_and_conquer_cells = 0;
+					TEST_TRUE("parallel divide and conquer", *constrained_max_time(rides, budget, window, parallel) == *plan);
+					ConstrainedOptions pruned = options;
+					pruned.prune_dominated = true;
+					auto pruned_plan = constrained_max_time(rides, budget, window, pruned);
+					TEST_TRUE("pruned fits", fits(*pruned_plan, budget, window));
+					TEST_TRUE("pruned optimal", std::abs(total_time(*pruned_plan) - best) < 1e-6);
+				}
+			}
+
+			// A window no plan can fill, in coarse steps
+			RideVector many(filtered_rides->begin(), filtered_rides->begin() + 300);
+			ConstrainedOptions coarse;
+			coarse.duration_step = 100;
+			double window = total_time(many) + many.size() * coarse.duration_step;
+			auto unconstrained = dynamic_max_time(many, 500);
+			TEST_TRUE("open window", std::abs(total_time(*constrained_max_time(many, 500, window, coarse)) - total_time(*unconstrained)) < 1e-6);
+			TEST_TRUE("negative window", constrained_max_time(many, 500, -1)->empty());
+		}
+	);
+	
 	return rubric.run();
 }
 
@@ -0,0 +1,405 @@
+///////////////////////////////////////////////////////////////////////////////
+// thread_pool.hh
+//
+// Persistent worker threads for the parallel solvers in maxtime.hh.
+//
+// A ThreadPool runs one task on every thread of a fixed-size team at once,
+// which lets the task synchronize its phases with a Barrier without paying for
+// thread creation on each phase.
+//
+// A WorkStealingPool instead runs independent tasks, one per thread at a time,
+// for servers such as MaxTimeService in maxtime_service.hh.
+//
+// How to use:
+//
+//    ThreadPool pool(4);
+//    Barrier barrier(pool.size());
+//    pool.run_team([&](size_t index)
+//    {
+//        // phase 1 for this index ...
+//        barrier.wait();
+//        // phase 2 for this index ...
+//    });
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Reusable barrier for a fixed number of threads.
+// Waiters spin for a short while, since team phases are usually short, then yield.
+class Barrier
+{
+	//
+	public:
+
+		//
+		explicit Barrier(size_t count)
+			:
+			_count(count),
+			_waiting(0),
+			_generation(0)
+		{
+			assert(count > 0);
+		}
+
+		// Block until count threads have called wait() for the current phase.
+		void wait()
+		{
+			size_t generation = _generation.load(std::memory_order_acquire);
+			if (_waiting.fetch_add(1, std::memory_order_acq_rel) + 1 == _count)
+			{
+				_waiting.store(0, std::memory_order_relaxed);
+				_generation.fetch_add(1, std::memory_order_acq_rel);
+				return;
+			}
+
+			for (unsigned spins = 0; _generation.load(std::memory_order_acquire) == generation; spins++)
+			{
+				if (spins >= spin_limit)
+				{
+					std::this_thread::yield();
+				}
+			}
+		}
+
+	//
+	private:
+
+		//
+		static constexpr unsigned spin_limit = 1024;
+
+		//
+		const size_t _count;
+		std::atomic<size_t> _waiting, _generation;
+};
+
+
+// Fixed team of threads; the calling thread of run_team() is member 0 of the team, and
+// size() - 1 workers are started once, by the constructor.
+class ThreadPool
+{
+	//
+	public:
+
+		//
+		explicit ThreadPool(size_t threads)
+			:
+			_size(threads > 0 ? threads : 1),
+			_generation(0),
+			_running(0),
+			_stopping(false)
+		{
+			for (size_t index = 1; index < _size; index++)
+			{
+				_workers.emplace_back([this, index]() { work(index); });
+			}
+		}
+
+		//
+		~ThreadPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_stopping = true;
+			}
+			_wake.notify_all();
+			for (auto& worker : _workers)
+			{
+				worker.join();
+			}
+		}
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		// Number of threads in the team, including the caller of run_team().
+		size_t size() const { return _size; }
+
+		// Run task(index) on every team member at once, for index in [0, size()), and return
+		// once all of them have finished. If any task throws, one of the exceptions is rethrown
+		// here; tasks that wait on a Barrier must not throw, or their teammates never return.
+		// Calls from different threads are serialized.
+		void run_team(const std::function<void(size_t)>& task)
+		{
+			std::lock_guard<std::mutex> serialize(_run_mutex);
+
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_task = &task;
+				_failure = nullptr;
+				_running = _size - 1;
+				_generation++;
+			}
+			_wake.notify_all();
+
+			run_task(task, 0);
+
+			std::unique_lock<std::mutex> lock(_mutex);
+			_done.wait(lock, [this]() { return _running == 0; });
+			_task = nullptr;
+			if (_failure)
+			{
+				std::rethrow_exception(_failure);
+			}
+		}
+
+		// Call body(i) for every i in [0, count), spread over the team in chunks of grain.
+		void parallel_for(size_t count, size_t grain, const std::function<void(size_t)>& body)
+		{
+			grain = grain > 0 ? grain : 1;
+			std::atomic<size_t> next(0);
+			run_team([&](size_t)
+			{
+				for (size_t begin; (begin = next.fetch_add(grain)) < count; )
+				{
+					size_t end = std::min(count, begin + grain);
+					for (size_t i = begin; i < end; i++)
+					{
+						body(i);
+					}
+				}
+			});
+		}
+
+	//
+	private:
+
+		// Worker loop: wait for a new generation of work, run it, report back.
+		void work(size_t index)
+		{
+			size_t seen = 0;
+			for (;;)
+			{
+				const std::function<void(size_t)>* task;
+				{
+					std::unique_lock<std::mutex> lock(_mutex);
+					_wake.wait(lock, [&]() { return _stopping || _generation != seen; });
+					if (_stopping)
+					{
+						return;
+					}
+					seen = _generation;
+					task = _task;
+				}
+
+				run_task(*task, index);
+
+				std::lock_guard<std::mutex> lock(_mutex);
+				if (--_running == 0)
+				{
+					_done.notify_one();
+				}
+			}
+		}
+
+		//
+		void run_task(const std::function<void(size_t)>& task, size_t index)
+		{
+			try
+			{
+				task(index);
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				if (!_failure)
+				{
+					_failure = std::current_exception();
+				}
+			}
+		}
+
+		//
+		const size_t _size;
+		std::vector<std::thread> _workers;
+
+		// Guards everything below; _run_mutex keeps one run_team() at a time.
+		std::mutex _mutex, _run_mutex;
+		std::condition_variable _wake, _done;
+		const std::function<void(size_t)>* _task = nullptr;
+		size_t _generation, _running;
+		bool _stopping;
+		std::exception_ptr _failure;
+};
+
+
+// Fixed set of worker threads running independent tasks. Each worker has its own deque of
+// tasks: a task submitted from a worker goes to the back of that worker's deque, which the
+// worker runs newest first, and other tasks are dealt to the deques in turn. A worker whose
+// deque is empty steals the oldest task of another.
+// Tasks must not throw. The destructor runs every task already submitted, then stops.
+class WorkStealingPool
+{
+	//
+	public:
+
+		//
+		explicit WorkStealingPool(size_t threads)
+			:
+			_pending(0),
+			_next(0),
+			_stopping(false)
+		{
+			threads = threads > 0 ? threads : 1;
+			for (size_t index = 0; index < threads; index++)
+			{
+				_queues.emplace_back(new TaskQueue);
+			}
+			for (size_t index = 0; index < threads; index++)
+			{
+				_workers.emplace_back([this, index]() { work(index); });
+			}
+		}
+
+		//
+		~WorkStealingPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_stopping = true;
+			}
+			_wake.notify_all();
+			for (auto& worker : _workers)
+			{
+				worker.join();
+			}
+		}
+
+		WorkStealingPool(const WorkStealingPool&) = delete;
+		WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+		//
+		size_t size() const { return _workers.size(); }
+
+		// Queue task to run on one of the workers.
+		void submit(std::function<void()> task)
+		{
+			size_t index = current_worker() == this ? current_index() : _next.fetch_add(1) % _queues.size();
+			{
+				std::lock_guard<std::mutex> lock(_queues[index]->mutex);
+				_queues[index]->tasks.push_back(std::move(task));
+			}
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_pending++;
+			}
+			_wake.notify_one();
+		}
+
+	//
+	private:
+
+		//
+		struct TaskQueue
+		{
+			std::mutex mutex;
+			std::deque<std::function<void()>> tasks;
+		};
+
+		// The pool and worker index of the calling thread, if it is a worker.
+		static const WorkStealingPool*& current_worker()
+		{
+			static thread_local const WorkStealingPool* pool = nullptr;
+			return pool;
+		}
+		static size_t& current_index()
+		{
+			static thread_local size_t index = 0;
+			return index;
+		}
+
+		// The newest task of worker index, or else the oldest task of another worker.
+		bool take(size_t index, std::function<void()>& task)
+		{
+			for (size_t k = 0; k < _queues.size(); k++)
+			{
+				TaskQueue& queue = *_queues[(index + k) % _queues.size()];
+				std::lock_guard<std::mutex> lock(queue.mutex);
+				if (!queue.tasks.empty())
+				{
+					if (k == 0)
+					{
+						task = std::move(queue.tasks.back());
+						queue.tasks.pop_back();
+					}
+					else
+					{
+						task = std::move(queue.tasks.front());
+						queue.tasks.pop_front();
+					}
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// Worker loop: run tasks until stopping with none pending.
+		void work(size_t index)
+		{
+			current_worker() = this;
+			current_index() = index;
+			for (;;)
+			{
+				{
+					std::unique_lock<std::mutex> lock(_mutex);
+					_wake.wait(lock, [this]() { return _stopping || _pending > 0; });
+					if (_pending == 0)
+					{
+						return;
+					}
+					_pending--;
+				}
+
+				// A task is pending, and only its claimer may take it, so this finds one
+				std::function<void()> task;
+				while (!take(index, task))
+				{
+					std::this_thread::yield();
+				}
+				task();
+			}
+		}
+
+		//
+		std::vector<std::unique_ptr<TaskQueue>> _queues;
+		std::vector<std::thread> _workers;
+
+		// Guards _pending and _stopping; _pending counts submitted tasks not yet claimed
+		std::mutex _mutex;
+		std::condition_variable _wake;
+		size_t _pending;
+		std::atomic<size_t> _next;
+		bool _stopping;
+};
+
+
+// Process-wide pool with the given number of threads, created on first use and kept for
+// the lifetime of the program.
+ThreadPool& shared_thread_pool(size_t threads)
+{
+	static std::mutex mutex;
+	static std::map<size_t, std::unique_ptr<ThreadPool>> pools;
+
+	threads = threads > 0 ? threads : 1;
+	std::lock_guard<std::mutex> lock(mutex);
+	std::unique_ptr<ThreadPool>& pool = pools[threads];
+	if (!pool)
+	{
+		pool.reset(new ThreadPool(threads));
+	}
+	return *pool;
+}